@@ -66,22 +66,42 @@ typedef struct {
     bool f16c;
     bool rdrand;
     bool hypervisor;
+    bool nx;
 } cpu_features_t;
 
+// Geometry of one data/unified cache level
+typedef struct {
+    uint32_t size;       // Total size in bytes, 0 if unknown
+    uint32_t ways;       // Associativity, 0 if fully associative
+    uint32_t line_size;  // Line size in bytes
+    uint32_t sets;       // Number of sets
+} cpu_cache_level_t;
+
+typedef struct {
+    cpu_cache_level_t l2;
+    cpu_cache_level_t llc;   // Last-level cache (L3, or L2 when there is none)
+    uint32_t llc_level;      // Level of the last-level cache, 0 if unknown
+} cpu_cache_info_t;
+
 // Function declarations
 void cpu_detect_features(cpu_features_t* features);
+void cpu_detect_cache(cpu_cache_info_t* info);
 void cpu_init_fpu(void);
 void cpu_init_sse(void);
 void cpu_enable_sse(void);
 void cpu_enable_smp(void);
 uint32_t cpu_get_cr0(void);
 void cpu_set_cr0(uint32_t value);
+uint32_t cpu_get_cr2(void);
 uint32_t cpu_get_cr3(void);
 void cpu_set_cr3(uint32_t value);
 uint32_t cpu_get_cr4(void);
 void cpu_set_cr4(uint32_t value);
 void cpu_invlpg(void* linear_addr);
 void cpu_wbinvd(void);
+void cpu_enable_nx(void);
+uint64_t cpu_read_msr(uint32_t msr);
+void cpu_write_msr(uint32_t msr, uint64_t value);
 void cpu_enable_paging(void);
 void cpu_disable_paging(void);
 void cpu_hlt(void);
@@ -92,6 +112,10 @@ uint32_t cpu_get_flags(void);
 // CR4 bit definitions
 #define CR4_PAE         (1 << 5)
 #define CR4_PSE         (1 << 4)
+#define CR4_PGE         (1 << 7)
+
+// Model-specific registers
+#define MSR_PAT         0x277
 #define CR4_OSFXSR      (1 << 9)
 #define CR4_OSXMMEXCPT  (1 << 10)
 
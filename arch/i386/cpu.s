@@ -6,9 +6,11 @@ SECTION .text
 
 ; Exported symbols
 global cpu_detect_features
+global cpu_detect_cache
 global cpu_init_fpu
 global cpu_init_sse
 global cpu_get_cr0
+global cpu_get_cr2
 global cpu_set_cr0
 global cpu_get_cr3
 global cpu_set_cr3
@@ -16,6 +18,9 @@ global cpu_get_cr4
 global cpu_set_cr4
 global cpu_invlpg
 global cpu_wbinvd
+global cpu_enable_nx
+global cpu_read_msr
+global cpu_write_msr
 global cpu_enable_paging
 global cpu_disable_paging
 global cpu_enable_sse
@@ -88,8 +93,29 @@ struc CPU_FEATURES
     .f16c       resb 1    ; Half-precision convert
     .rdrand     resb 1    ; RDRAND instruction
     .hypervisor resb 1    ; Running under hypervisor
+    .nx         resb 1    ; No-execute page protection
 endstruc
 
+; Geometry of one data/unified cache level (matches cpu_cache_level_t)
+struc CPU_CACHE_LEVEL
+    .size       resd 1    ; Total size in bytes, 0 if unknown
+    .ways       resd 1    ; Associativity, 0 if fully associative
+    .line_size  resd 1    ; Line size in bytes
+    .sets       resd 1    ; Number of sets
+endstruc
+
+struc CPU_CACHE_INFO
+    .l2         resb CPU_CACHE_LEVEL_size
+    .llc        resb CPU_CACHE_LEVEL_size
+    .llc_level  resd 1    ; Level of the last-level cache, 0 if unknown
+endstruc
+
+; Store one CPUID register bit as a 0/1 feature byte
+%macro FEATURE_BIT 3            ; register, bit, field
+    bt %1, %2
+    setc byte [edi + CPU_FEATURES.%3]
+%endmacro
+
 ; Detect CPU features and populate CPU_FEATURES structure
 ; void cpu_detect_features(CPU_FEATURES* features);
 cpu_detect_features:
@@ -102,6 +128,12 @@ cpu_detect_features:
     
     mov edi, [ebp+8]  ; Get features struct pointer
     
+    ; Every feature reads as absent unless CPUID reports it
+    xor eax, eax
+    mov ecx, CPU_FEATURES_size
+    rep stosb
+    mov edi, [ebp+8]
+    
     ; Check if CPUID is supported
     pushfd
     pop eax
@@ -120,142 +152,81 @@ cpu_detect_features:
     cpuid
     
     ; EDX features
-    mov byte [edi + CPU_FEATURES.fpu], 1    ; Assume FPU exists if CPUID exists
-    test edx, 1 << 0  ; FPU
-    jnz .fpu_ok
-    mov byte [edi + CPU_FEATURES.fpu], 0
-.fpu_ok:
-    mov byte [edi + CPU_FEATURES.vme], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.de], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.pse], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.tsc], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.msr], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.pae], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.mce], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.cx8], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.apic], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.sep], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.mtrr], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.pge], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.mca], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.cmov], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.pat], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.pse36], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.psn], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.clfsh], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.ds], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.acpi], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.mmx], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.fxsr], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.sse], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.sse2], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.ss], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.htt], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.tm], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.ia64], dl
-    shr edx, 1
-    mov byte [edi + CPU_FEATURES.pbe], dl
+    FEATURE_BIT edx, 0, fpu
+    FEATURE_BIT edx, 1, vme
+    FEATURE_BIT edx, 2, de
+    FEATURE_BIT edx, 3, pse
+    FEATURE_BIT edx, 4, tsc
+    FEATURE_BIT edx, 5, msr
+    FEATURE_BIT edx, 6, pae
+    FEATURE_BIT edx, 7, mce
+    FEATURE_BIT edx, 8, cx8
+    FEATURE_BIT edx, 9, apic
+    FEATURE_BIT edx, 11, sep
+    FEATURE_BIT edx, 12, mtrr
+    FEATURE_BIT edx, 13, pge
+    FEATURE_BIT edx, 14, mca
+    FEATURE_BIT edx, 15, cmov
+    FEATURE_BIT edx, 16, pat
+    FEATURE_BIT edx, 17, pse36
+    FEATURE_BIT edx, 18, psn
+    FEATURE_BIT edx, 19, clfsh
+    FEATURE_BIT edx, 21, ds
+    FEATURE_BIT edx, 22, acpi
+    FEATURE_BIT edx, 23, mmx
+    FEATURE_BIT edx, 24, fxsr
+    FEATURE_BIT edx, 25, sse
+    FEATURE_BIT edx, 26, sse2
+    FEATURE_BIT edx, 27, ss
+    FEATURE_BIT edx, 28, htt
+    FEATURE_BIT edx, 29, tm
+    FEATURE_BIT edx, 30, ia64
+    FEATURE_BIT edx, 31, pbe
     
     ; ECX features (CPUID.1:ECX)
-    mov byte [edi + CPU_FEATURES.sse3], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.pclmul], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.dtes64], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.monitor], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.ds_cpl], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.vmx], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.smx], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.est], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.tm2], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.ssse3], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.cid], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.sdbg], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.fma], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.cx16], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.xtpr], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.pdcm], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.pcid], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.dca], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.sse4_1], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.sse4_2], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.x2apic], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.movbe], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.popcnt], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.tsc_deadline], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.aes], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.xsave], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.osxsave], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.avx], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.f16c], cl
-    shr ecx, 1
-    mov byte [edi + CPU_FEATURES.rdrand], cl
-    shr ecx, 1
+    FEATURE_BIT ecx, 0, sse3
+    FEATURE_BIT ecx, 1, pclmul
+    FEATURE_BIT ecx, 2, dtes64
+    FEATURE_BIT ecx, 3, monitor
+    FEATURE_BIT ecx, 4, ds_cpl
+    FEATURE_BIT ecx, 5, vmx
+    FEATURE_BIT ecx, 6, smx
+    FEATURE_BIT ecx, 7, est
+    FEATURE_BIT ecx, 8, tm2
+    FEATURE_BIT ecx, 9, ssse3
+    FEATURE_BIT ecx, 10, cid
+    FEATURE_BIT ecx, 11, sdbg
+    FEATURE_BIT ecx, 12, fma
+    FEATURE_BIT ecx, 13, cx16
+    FEATURE_BIT ecx, 14, xtpr
+    FEATURE_BIT ecx, 15, pdcm
+    FEATURE_BIT ecx, 17, pcid
+    FEATURE_BIT ecx, 18, dca
+    FEATURE_BIT ecx, 19, sse4_1
+    FEATURE_BIT ecx, 20, sse4_2
+    FEATURE_BIT ecx, 21, x2apic
+    FEATURE_BIT ecx, 22, movbe
+    FEATURE_BIT ecx, 23, popcnt
+    FEATURE_BIT ecx, 24, tsc_deadline
+    FEATURE_BIT ecx, 25, aes
+    FEATURE_BIT ecx, 26, xsave
+    FEATURE_BIT ecx, 27, osxsave
+    FEATURE_BIT ecx, 28, avx
+    FEATURE_BIT ecx, 29, f16c
+    FEATURE_BIT ecx, 30, rdrand
     
     ; Check for hypervisor
-    mov eax, 0x1
-    cpuid
-    test ecx, 1 << 31
-    setnz byte [edi + CPU_FEATURES.hypervisor]
+    FEATURE_BIT ecx, 31, hypervisor
     
     ; Get extended features (CPUID.80000001h:EDX/ECX)
+    mov eax, 0x80000000
+    cpuid
+    cmp eax, 0x80000001
+    jb .no_cpuid
     mov eax, 0x80000001
     cpuid
     
-    ; TODO: Process extended features
+    FEATURE_BIT edx, 20, nx
     
 .no_cpuid:
     pop edi
@@ -265,6 +236,140 @@ cpu_detect_features:
     pop ebp
     ret
 
+;; Copy the cache level built on the stack into a CPU_CACHE_INFO field
+%macro STORE_CACHE_LEVEL 1      ; destination field offset
+    mov ecx, [esp + CPU_CACHE_LEVEL.size]
+    mov [edi + %1 + CPU_CACHE_LEVEL.size], ecx
+    mov ecx, [esp + CPU_CACHE_LEVEL.ways]
+    mov [edi + %1 + CPU_CACHE_LEVEL.ways], ecx
+    mov ecx, [esp + CPU_CACHE_LEVEL.line_size]
+    mov [edi + %1 + CPU_CACHE_LEVEL.line_size], ecx
+    mov ecx, [esp + CPU_CACHE_LEVEL.sets]
+    mov [edi + %1 + CPU_CACHE_LEVEL.sets], ecx
+%endmacro
+
+; Detect L2 and last-level cache geometry from the deterministic cache
+; parameters (CPUID.4), falling back to the extended L2 descriptor
+; (CPUID.80000006h:ECX) on processors without leaf 4
+; void cpu_detect_cache(CPU_CACHE_INFO* info);
+cpu_detect_cache:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    sub esp, CPU_CACHE_LEVEL_size   ; Scratch level
+    
+    mov edi, [ebp+8]
+    xor eax, eax
+    mov ecx, CPU_CACHE_INFO_size / 4
+    rep stosd
+    mov edi, [ebp+8]
+    
+    ; Check if CPUID is supported
+    pushfd
+    pop eax
+    mov ecx, eax
+    xor eax, 0x200000 ; Flip ID bit
+    push eax
+    popfd
+    pushfd
+    pop eax
+    xor eax, ecx
+    jz .done
+    
+    xor eax, eax
+    cpuid
+    cmp eax, 4
+    jb .legacy
+    
+    xor esi, esi            ; Sub-leaf: one per cache
+.next_cache:
+    mov eax, 4
+    mov ecx, esi
+    cpuid
+    mov edx, eax
+    and edx, 0x1F           ; Cache type, 0 = no more caches
+    jz .leaf4_end
+    cmp edx, 2              ; Instruction caches do not hold data
+    je .skip_cache
+    
+    inc ecx                 ; ECX = sets - 1
+    mov [esp + CPU_CACHE_LEVEL.sets], ecx
+    mov ecx, ebx
+    and ecx, 0xFFF          ; EBX[11:0] = line size - 1
+    inc ecx
+    mov [esp + CPU_CACHE_LEVEL.line_size], ecx
+    mov edx, ebx
+    shr edx, 12
+    and edx, 0x3FF          ; EBX[21:12] = line partitions - 1
+    inc edx
+    imul ecx, edx
+    shr ebx, 22             ; EBX[31:22] = ways - 1
+    inc ebx
+    mov [esp + CPU_CACHE_LEVEL.ways], ebx
+    imul ecx, ebx
+    imul ecx, [esp + CPU_CACHE_LEVEL.sets]
+    mov [esp + CPU_CACHE_LEVEL.size], ecx
+    
+    shr eax, 5
+    and eax, 7              ; EAX[7:5] = cache level
+    cmp eax, 2
+    jne .not_l2
+    STORE_CACHE_LEVEL CPU_CACHE_INFO.l2
+.not_l2:
+    cmp eax, [edi + CPU_CACHE_INFO.llc_level]
+    jb .skip_cache
+    mov [edi + CPU_CACHE_INFO.llc_level], eax
+    STORE_CACHE_LEVEL CPU_CACHE_INFO.llc
+.skip_cache:
+    inc esi
+    cmp esi, 16
+    jb .next_cache
+.leaf4_end:
+    cmp dword [edi + CPU_CACHE_INFO.llc_level], 0
+    jne .done               ; Otherwise leaf 4 is reserved (AMD)
+    
+.legacy:
+    mov eax, 0x80000000
+    cpuid
+    cmp eax, 0x80000006
+    jb .done
+    mov eax, 0x80000006
+    cpuid
+    movzx eax, cl           ; ECX[7:0] = line size
+    test eax, eax
+    jz .done                ; No L2 reported
+    mov [esp + CPU_CACHE_LEVEL.line_size], eax
+    mov ebx, ecx
+    shr ebx, 16             ; ECX[31:16] = size in KB
+    shl ebx, 10
+    mov [esp + CPU_CACHE_LEVEL.size], ebx
+    shr ecx, 12
+    and ecx, 0xF            ; ECX[15:12] = encoded associativity
+    movzx ecx, byte [l2_assoc_ways + ecx]
+    mov [esp + CPU_CACHE_LEVEL.ways], ecx
+    mov dword [esp + CPU_CACHE_LEVEL.sets], 0
+    test ecx, ecx
+    jz .legacy_store        ; Fully associative: no sets to speak of
+    imul ecx, eax
+    mov eax, ebx
+    xor edx, edx
+    div ecx
+    mov [esp + CPU_CACHE_LEVEL.sets], eax
+.legacy_store:
+    STORE_CACHE_LEVEL CPU_CACHE_INFO.l2
+    STORE_CACHE_LEVEL CPU_CACHE_INFO.llc
+    mov dword [edi + CPU_CACHE_INFO.llc_level], 2
+    
+.done:
+    add esp, CPU_CACHE_LEVEL_size
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
 ; Initialize FPU
 ; void cpu_init_fpu(void);
 cpu_init_fpu:
@@ -315,6 +420,12 @@ cpu_set_cr0:
     mov cr0, eax
     ret
 
+; Get CR2 register (page fault linear address)
+; uint32_t cpu_get_cr2(void);
+cpu_get_cr2:
+    mov eax, cr2
+    ret
+
 ; Get CR3 register (page directory base)
 ; uint32_t cpu_get_cr3(void);
 cpu_get_cr3:
@@ -370,6 +481,31 @@ cpu_disable_paging:
     mov cr0, eax
     ret
 
+; Allow the NX bit in PAE page table entries (EFER.NXE)
+; void cpu_enable_nx(void);
+cpu_enable_nx:
+    mov ecx, 0xC0000080 ; IA32_EFER MSR
+    rdmsr
+    or eax, 0x800       ; Set NXE
+    wrmsr
+    ret
+
+; Read a model-specific register
+; uint64_t cpu_read_msr(uint32_t msr);
+cpu_read_msr:
+    mov ecx, [esp+4]
+    rdmsr               ; Result in EDX:EAX
+    ret
+
+; Write a model-specific register
+; void cpu_write_msr(uint32_t msr, uint64_t value);
+cpu_write_msr:
+    mov ecx, [esp+4]
+    mov eax, [esp+8]    ; Low half
+    mov edx, [esp+12]   ; High half
+    wrmsr
+    ret
+
 ; Enable SMP features (must be called on BSP only)
 ; void cpu_enable_smp(void);
 cpu_enable_smp:
@@ -407,4 +543,10 @@ cpu_get_flags:
     pop eax
     ret
 
+SECTION .rodata
+
+; Ways for each CPUID.80000006h:ECX[15:12] associativity encoding
+l2_assoc_ways:
+    db 0, 1, 2, 3, 4, 6, 8, 0, 16, 0, 32, 48, 64, 96, 128, 0
+
 section .note.GNU-stack noalloc noexec nowrite progbits
@@ -0,0 +1,41 @@
+#include <arch/i386/idt.h>
+#include <arch/i386/cpu.h>
+#include <sys/panic.h>
+#include <vmm.h>
+#include <paging.h>
+#include <string.h>
+
+static idt_entry_t idt[IDT_ENTRIES] __attribute__((aligned(8)));
+static idt_ptr_t idtr;
+
+// Install a ring 0 interrupt gate in the current code segment
+void idt_set_gate(uint8_t vector, void (*handler)(void)) {
+    uintptr_t addr = (uintptr_t)handler;
+    uint16_t cs;
+
+    asm volatile("mov %%cs, %0" : "=r"(cs));
+    idt[vector].offset_low = addr & 0xFFFF;
+    idt[vector].selector = cs;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = 0x8E;   // Present, DPL 0, 32-bit interrupt gate
+    idt[vector].offset_high = addr >> 16;
+}
+
+void idt_init(void) {
+    memset(idt, 0, sizeof(idt));
+    idt_set_gate(IDT_VECTOR_PF, isr_page_fault);
+
+    idtr.limit = sizeof(idt) - 1;
+    idtr.base = (uintptr_t)idt;
+    idt_load(&idtr);
+}
+
+// Called from isr_page_fault with the faulting address in CR2
+void trap_page_fault(uint32_t error) {
+    uintptr_t addr = cpu_get_cr2();
+
+    if (vm_space_handle_cow(addr, error)) return;
+    if (!vmm_handle_fault(addr, error)) {
+        PANIC("Unhandled page fault");
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef ARCH_I386_IDT_H
+#define ARCH_I386_IDT_H
+
+#include <stdint.h>
+
+#define IDT_ENTRIES     256
+#define IDT_VECTOR_PF   14      // Page fault
+
+// 32-bit interrupt gate
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+// Function declarations
+void idt_init(void);
+void idt_set_gate(uint8_t vector, void (*handler)(void));
+void trap_page_fault(uint32_t error);
+
+// Assembly entry points (idt.s)
+void idt_load(const idt_ptr_t* idtr);
+void isr_page_fault(void);
+
+#endif // ARCH_I386_IDT_H
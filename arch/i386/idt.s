@@ -0,0 +1,31 @@
+; Interrupt descriptor table loading and exception entry stubs
+
+[BITS 32]
+SECTION .text
+
+; Exported symbols
+global idt_load
+global isr_page_fault
+
+extern trap_page_fault
+
+; Load the interrupt descriptor table register
+; void idt_load(const idt_ptr_t* idtr);
+idt_load:
+    mov eax, [esp+4]
+    lidt [eax]
+    ret
+
+; Page fault (vector 14): the CPU has pushed an error code
+; void isr_page_fault(void);
+isr_page_fault:
+    pushad
+    cld
+    push dword [esp + 32]   ; Error code, above the saved registers
+    call trap_page_fault
+    add esp, 4
+    popad
+    add esp, 4              ; Drop the error code
+    iretd
+
+section .note.GNU-stack noalloc noexec nowrite progbits
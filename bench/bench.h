@@ -0,0 +1,23 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host-side benchmarks. Kernel sources are compiled for the host and the
+// PMM is handed an anonymous mapping at a fixed address standing in for
+// physical memory, so frame addresses are real host pointers.
+#define BENCH_PHYS_BASE 0x40000000UL
+
+// Map pages of host memory at BENCH_PHYS_BASE and register them as one
+// NORMAL region with a freshly initialized PMM. Exits on failure.
+void bench_pmm_setup(size_t pages);
+
+// Monotonic clock in nanoseconds
+uint64_t bench_ns(void);
+
+// Small deterministic generator so every run sees the same workload
+uint32_t bench_rand(void);
+void bench_srand(uint32_t seed);
+
+#endif // BENCH_H
@@ -0,0 +1,54 @@
+#include "bench.h"
+#include <pmm.h>
+#include <arch/i386/cpu.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+// The PMM sizes its colors from the L2. Report a fixed 512 KB, 8-way cache
+// with 64-byte lines (16 colors) so results do not depend on the host CPU.
+void cpu_detect_cache(cpu_cache_info_t *info) {
+    memset(info, 0, sizeof(*info));
+    info->l2.size = 512 * 1024;
+    info->l2.ways = 8;
+    info->l2.line_size = 64;
+    info->l2.sets = info->l2.size / (info->l2.ways * info->l2.line_size);
+    info->llc = info->l2;
+    info->llc_level = 2;
+}
+
+void bench_pmm_setup(size_t pages) {
+    size_t bytes = pages * PMM_PAGE_SIZE;
+    void *mem = mmap((void *)BENCH_PHYS_BASE, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (mem != (void *)BENCH_PHYS_BASE) {
+        fprintf(stderr, "bench: cannot map %zu pages at 0x%lx\n", pages, BENCH_PHYS_BASE);
+        exit(1);
+    }
+    if (pmm_init() != 0 || pmm_add_region(BENCH_PHYS_BASE, bytes, PMM_ZONE_NORMAL) != 0) {
+        fprintf(stderr, "bench: PMM setup failed\n");
+        exit(1);
+    }
+}
+
+uint64_t bench_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint32_t rand_state = 1;
+
+void bench_srand(uint32_t seed) {
+    rand_state = seed ? seed : 1;
+}
+
+uint32_t bench_rand(void) {
+    // xorshift32
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
@@ -0,0 +1,51 @@
+#include "klibc.h"
+#include <pmm.h>
+
+// The renamed heaps call k_pmm_* and p_pmm_*; route both to the host-built
+// PMM and count the pages they hold
+static size_t pages_held;
+static size_t pages_peak;
+
+size_t klibc_pages(void) {
+    return pages_held;
+}
+
+size_t klibc_peak_pages(void) {
+    return pages_peak;
+}
+
+void klibc_reset_peak(void) {
+    pages_peak = pages_held;
+}
+
+static void *heap_alloc_pages(size_t count) {
+    void *pages = pmm_alloc_pages(count);
+    if (pages) {
+        pages_held += count;
+        if (pages_held > pages_peak) pages_peak = pages_held;
+    }
+    return pages;
+}
+
+static int heap_free_pages(void *addr, size_t count) {
+    int result = pmm_free_pages(addr, count);
+    if (result == 0) pages_held -= count;
+    return result;
+}
+
+#define KLIBC_PMM_GLUE(prefix)                                                  \
+    void *prefix##pmm_alloc_pages(size_t count) {                               \
+        return heap_alloc_pages(count);                                         \
+    }                                                                           \
+    int prefix##pmm_free_pages(void *addr, size_t count) {                      \
+        return heap_free_pages(addr, count);                                    \
+    }                                                                           \
+    int prefix##pmm_page_set_owner(void *addr, size_t count, uint32_t owner) {  \
+        return pmm_page_set_owner(addr, count, owner);                          \
+    }                                                                           \
+    pmm_stats_t prefix##pmm_get_stats(void) {                                   \
+        return pmm_get_stats();                                                 \
+    }
+
+KLIBC_PMM_GLUE(k_)
+KLIBC_PMM_GLUE(p_)
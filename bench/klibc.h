@@ -0,0 +1,36 @@
+#ifndef KLIBC_H
+#define KLIBC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// The kernel's lib/libc heap, built freestanding for the host and renamed
+// so it links beside the host C library: k_ for the normal build, p_ for
+// the build with MALLOC_PROFILE. Both take their pages from pmm.c.
+void *k_malloc(size_t size);
+void *k_calloc(size_t num, size_t size);
+void *k_realloc(void *ptr, size_t size);
+void k_free(void *ptr);
+void *k_memcpy(void *dest, const void *src, size_t n);
+
+void *p_malloc(size_t size);
+void *p_realloc(void *ptr, size_t size);
+void p_free(void *ptr);
+
+// Same layout as malloc_site_t in usr/include/stdlib.h
+typedef struct {
+    void *site;
+    size_t bytes;
+    size_t count;
+    size_t samples;
+} kmalloc_site_t;
+
+size_t p_malloc_profile_sites(kmalloc_site_t *out, size_t max, bool by_count);
+void p_malloc_profile_reset(void);
+
+// PMM pages the heaps hold now and at most since the last reset
+size_t klibc_pages(void);
+size_t klibc_peak_pages(void);
+void klibc_reset_peak(void);
+
+#endif // KLIBC_H
@@ -0,0 +1,87 @@
+// File append: grow a buffer to 1 MB in 512-byte writes the way
+// fs_resize_file() grows file data, realloc() to the next 512-byte block
+// on every write. fs.c caps files at MAX_FILE_SIZE, so the growth pattern
+// is replayed here directly. Compares the kernel realloc() with the one it
+// replaced, which always allocated a new block and copied byte by byte,
+// and with always moving through the word-wise memcpy().
+#include "bench.h"
+#include "klibc.h"
+#include <stdio.h>
+#include <string.h>
+
+#define REGION_PAGES 16384
+#define FILE_BYTES   (1024 * 1024)
+#define WRITE_BYTES  512
+#define ROUNDS       5
+
+static size_t moves;
+
+// The old realloc(), on top of the current heap; kept scalar so the copy
+// stays one byte at a time
+__attribute__((optimize("no-tree-loop-distribute-patterns", "no-tree-vectorize")))
+static void *old_realloc(void *ptr, size_t size) {
+    unsigned char *new_ptr = k_malloc(size);
+    if (new_ptr && ptr) {
+        size_t old_size = size - WRITE_BYTES;   // Always growing by one write
+        const unsigned char *src = ptr;
+        for (size_t i = 0; i < old_size; i++) new_ptr[i] = src[i];
+        k_free(ptr);
+    }
+    return new_ptr;
+}
+
+// Always moving, but with the word-wise memcpy()
+static void *move_realloc(void *ptr, size_t size) {
+    unsigned char *new_ptr = k_malloc(size);
+    if (new_ptr && ptr) {
+        k_memcpy(new_ptr, ptr, size - WRITE_BYTES);
+        k_free(ptr);
+    }
+    return new_ptr;
+}
+
+static void *new_realloc(void *ptr, size_t size) {
+    return k_realloc(ptr, size);
+}
+
+// One append run; with interleave, another 40-byte allocation lands after
+// each write, as when a command allocates while a file grows
+static uint64_t append(void *(*grow)(void *, size_t), bool interleave) {
+    static void *noise[FILE_BYTES / WRITE_BYTES];
+    unsigned char block[WRITE_BYTES];
+    memset(block, 'x', sizeof(block));
+
+    uint64_t t0 = bench_ns();
+    unsigned char *data = NULL;
+    for (size_t size = 0, n = 0; size < FILE_BYTES; size += WRITE_BYTES, n++) {
+        unsigned char *grown = grow(data, size + WRITE_BYTES);
+        if (grown != data) moves++;
+        data = grown;
+        memcpy(data + size, block, WRITE_BYTES);
+        noise[n] = interleave ? k_malloc(40) : NULL;
+    }
+    uint64_t elapsed = bench_ns() - t0;
+
+    k_free(data);
+    for (size_t n = 0; n < FILE_BYTES / WRITE_BYTES; n++) k_free(noise[n]);
+    return elapsed;
+}
+
+static void run(const char *name, void *(*grow)(void *, size_t), bool interleave) {
+    uint64_t total = 0;
+    moves = 0;
+    for (size_t round = 0; round < ROUNDS; round++) total += append(grow, interleave);
+    printf("%-28s %9.2f ms %6zu moves\n", name, total / 1e6 / ROUNDS, moves / ROUNDS);
+}
+
+int main(void) {
+    bench_pmm_setup(REGION_PAGES);
+
+    printf("%d KB in %d-byte writes, mean of %d runs\n", FILE_BYTES / 1024, WRITE_BYTES, ROUNDS);
+    run("always move, byte copy", old_realloc, false);
+    run("always move, memcpy", move_realloc, false);
+    run("realloc", new_realloc, false);
+    run("always move, byte copy +40B", old_realloc, true);
+    run("realloc +40B", new_realloc, true);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// Heap profiler cost and accuracy: the same allocation-heavy loop through
+// the kernel heap built without and with MALLOC_PROFILE, then the sampled
+// per-site estimates against the bytes and calls each site really made.
+#include "bench.h"
+#include "klibc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REGION_PAGES 16384
+#define SLOTS        1024
+#define OPS          4000000
+#define ROUNDS       5
+
+typedef struct {
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+} heap_impl_t;
+
+static uint64_t churn(const heap_impl_t *heap) {
+    static void *slot[SLOTS];
+    bench_srand(99);
+    uint64_t t0 = bench_ns();
+    for (size_t op = 0; op < OPS; op++) {
+        size_t i = bench_rand() % SLOTS;
+        if (slot[i]) {
+            heap->free(slot[i]);
+            slot[i] = NULL;
+        } else {
+            slot[i] = heap->malloc(16 + bench_rand() % 496);
+        }
+    }
+    uint64_t elapsed = bench_ns() - t0;
+    for (size_t i = 0; i < SLOTS; i++) {
+        heap->free(slot[i]);
+        slot[i] = NULL;
+    }
+    return elapsed;
+}
+
+// Three call sites with known totals. The empty asm keeps the call from
+// becoming a tail jump, so the return address stays inside the site.
+#define SITE(name, size, calls)                                 \
+    __attribute__((noinline)) static void *name(void) {         \
+        void *p = p_malloc(size);                               \
+        __asm__ volatile("" : : "r"(p) : "memory");             \
+        return p;                                               \
+    }                                                           \
+    static const size_t name##_size = (size), name##_calls = (calls);
+
+SITE(site_small, 24, 400000)
+SITE(site_medium, 700, 20000)
+SITE(site_large, 9000, 500)
+
+typedef struct {
+    const char *name;
+    void *(*fn)(void);
+    size_t size;
+    size_t calls;
+} site_info_t;
+
+// The recorded return address lies inside the site function: the one
+// starting closest below it
+static const site_info_t *site_owner(const kmalloc_site_t *s, const site_info_t *info, size_t n) {
+    const site_info_t *owner = NULL;
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t fn = (uintptr_t)info[i].fn;
+        if (fn < (uintptr_t)s->site && (!owner || fn > (uintptr_t)owner->fn)) owner = &info[i];
+    }
+    return owner;
+}
+
+static void report_site(const site_info_t *info, const kmalloc_site_t *s) {
+    size_t bytes = info->size * info->calls;
+    printf("%-8s bytes %9zu est %9zu (%+5.1f%%)   calls %7zu est %7zu (%+5.1f%%)   %5zu samples\n",
+           info->name, bytes, s->bytes, 100.0 * ((double)s->bytes - bytes) / bytes,
+           info->calls, s->count, 100.0 * ((double)s->count - info->calls) / info->calls,
+           s->samples);
+}
+
+int main(void) {
+    bench_pmm_setup(REGION_PAGES);
+
+    const heap_impl_t plain = { k_malloc, k_free };
+    const heap_impl_t profiled = { p_malloc, p_free };
+    uint64_t best_plain = UINT64_MAX, best_profiled = UINT64_MAX;
+    for (size_t round = 0; round < ROUNDS; round++) {
+        uint64_t t = churn(&plain);
+        if (t < best_plain) best_plain = t;
+        t = churn(&profiled);
+        if (t < best_profiled) best_profiled = t;
+    }
+    printf("%d malloc/free ops of 16-511 bytes, best of %d\n", OPS, ROUNDS);
+    printf("%-12s %7.2f ns/op\n", "plain", (double)best_plain / OPS);
+    printf("%-12s %7.2f ns/op (%+.1f%%)\n", "profiled", (double)best_profiled / OPS,
+           100.0 * ((double)best_profiled - best_plain) / best_plain);
+
+    // Interleave the sites so each sees the countdown in every state
+    p_malloc_profile_reset();
+    static void *held[SLOTS];
+    size_t next = 0;
+    for (size_t i = 0; i < site_small_calls; i++) {
+        void *p[3] = { site_small(), NULL, NULL };
+        if (i % (site_small_calls / site_medium_calls) == 0) p[1] = site_medium();
+        if (i % (site_small_calls / site_large_calls) == 0) p[2] = site_large();
+        for (size_t j = 0; j < 3; j++) {
+            if (!p[j]) continue;
+            p_free(held[next]);
+            held[next] = p[j];
+            next = (next + 1) % SLOTS;
+        }
+    }
+
+    const site_info_t info[] = {
+        { "24 B", site_small, site_small_size, site_small_calls },
+        { "700 B", site_medium, site_medium_size, site_medium_calls },
+        { "9000 B", site_large, site_large_size, site_large_calls },
+    };
+    kmalloc_site_t sites[16];
+    size_t n = p_malloc_profile_sites(sites, 16, false);
+    printf("\nSampled estimates (interval 4096 bytes)\n");
+    for (size_t i = 0; i < n && i < 16; i++) {
+        const site_info_t *owner = site_owner(&sites[i], info, 3);
+        if (owner) report_site(owner, &sites[i]);
+    }
+    return 0;
+}
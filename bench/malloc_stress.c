@@ -0,0 +1,98 @@
+// Heap stress: random malloc/calloc/realloc/free over 4096 live slots,
+// mostly small blocks with a tail of large ones, against the kernel heap
+// and the host C library. Each heap runs in its own child process so its
+// peak RSS is reported on its own.
+#include "bench.h"
+#include "klibc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define REGION_PAGES 65536      // 256 MB of fake physical memory
+#define SLOTS        4096
+#define OPS          2000000
+
+typedef struct {
+    const char *name;
+    void *(*malloc)(size_t size);
+    void *(*calloc)(size_t num, size_t size);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*free)(void *ptr);
+} heap_impl_t;
+
+static size_t random_size(void) {
+    uint32_t r = bench_rand() % 1000;
+    if (r < 5) return 1 + bench_rand() % 200000;
+    if (r < 100) return 1 + bench_rand() % 8000;
+    return 1 + bench_rand() % 512;
+}
+
+static void stress(const heap_impl_t *heap) {
+    static unsigned char *slot[SLOTS];
+    static size_t slot_size[SLOTS];
+
+    bench_srand(4242);
+    uint64_t t0 = bench_ns();
+    size_t op;
+    for (op = 0; op < OPS; op++) {
+        size_t i = bench_rand() % SLOTS;
+        if (!slot[i]) {
+            slot_size[i] = random_size();
+            slot[i] = bench_rand() % 5 == 0 ? heap->calloc(1, slot_size[i])
+                                            : heap->malloc(slot_size[i]);
+            if (!slot[i]) break;
+            memset(slot[i], (int)i, slot_size[i]);
+        } else if (bench_rand() % 4 == 0) {
+            size_t size = random_size();
+            unsigned char *p = heap->realloc(slot[i], size);
+            if (!p) break;
+            slot[i] = p;
+            if (size > slot_size[i]) memset(slot[i] + slot_size[i], (int)i, size - slot_size[i]);
+            slot_size[i] = size;
+        } else {
+            heap->free(slot[i]);
+            slot[i] = NULL;
+        }
+    }
+    uint64_t elapsed = bench_ns() - t0;
+    if (op < OPS) {
+        printf("%-12s out of memory after %zu ops\n", heap->name, op);
+        exit(1);
+    }
+    for (size_t i = 0; i < SLOTS; i++) heap->free(slot[i]);
+
+    printf("%-12s %6.2f Mops/s", heap->name, OPS / (elapsed / 1e3));
+}
+
+static void run(const heap_impl_t *heap, bool kernel) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        struct rusage before;
+        getrusage(RUSAGE_SELF, &before);
+        stress(heap);
+        struct rusage after;
+        getrusage(RUSAGE_SELF, &after);
+        printf("   peak RSS +%6ld KB", after.ru_maxrss - before.ru_maxrss);
+        if (kernel) printf("   peak PMM pages %zu (%zu KB)", klibc_peak_pages(), klibc_peak_pages() * 4);
+        printf("\n");
+        exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+}
+
+int main(void) {
+    bench_pmm_setup(REGION_PAGES);
+
+    const heap_impl_t kernel = { "kernel heap", k_malloc, k_calloc, k_realloc, k_free };
+    const heap_impl_t host = { "host libc", malloc, calloc, realloc, free };
+
+    printf("%d ops over %d slots\n", OPS, SLOTS);
+    run(&kernel, true);
+    run(&host, false);
+    return 0;
+}
@@ -0,0 +1,299 @@
+// Paging and VMM checks: paging.c with its CR0/CR3/CR4 and invlpg
+// instructions stubbed out (see the Makefile), vmm.c and pmm.c, all on
+// the fake physical memory of bench_pmm_setup(). Page tables are written
+// through their frame addresses, which are host pointers. Run without
+// arguments for two-level paging and with "pae" for PAE.
+#include "bench.h"
+#include <pmm.h>
+#include <vmm.h>
+#include <paging.h>
+#include <arch/i386/cpu.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define REGION_PAGES 16384          // 64 MB, room for one 4 MB large page
+#define USER_BASE    0x60000000UL   // User mappings; backed on the host so
+#define USER_BYTES   0x400000UL     // copy-on-write can read the source
+#define PAT_EXPECTED 0x0007040600070106ULL
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                    #cond);                                                 \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+static bool use_pae;
+static uint64_t pat_written;
+
+// The processor as paging.c sees it: PSE, PGE, NX and PAT, PAE on request
+void cpu_detect_features(cpu_features_t *features) {
+    memset(features, 0, sizeof(*features));
+    features->pse = 1;
+    features->pge = 1;
+    features->pae = use_pae;
+    features->nx = 1;
+    features->pat = 1;
+    features->msr = 1;
+}
+
+void cpu_enable_nx(void) {}
+void cpu_wbinvd(void) {}
+
+void cpu_write_msr(uint32_t msr, uint64_t value) {
+    CHECK(msr == MSR_PAT);
+    pat_written = value;
+}
+
+static void test_identity_map(void) {
+    uintptr_t top = pmm_highest_address();
+    CHECK(paging_get_physical(0x123456) == 0x123000);
+    CHECK(paging_get_physical(top - PAGE_SIZE) == top - PAGE_SIZE);
+    CHECK(paging_get_physical(top) == 0);
+    for (uintptr_t addr = 0; addr < top; addr += 0x7000)
+        CHECK(paging_get_physical(addr) == (addr & ~(uintptr_t)0xFFF));
+
+    // Changing one page splits the large page around it
+    size_t large = paging_large_pages();
+    CHECK(paging_map_page(0x805000, 0x7000, PAGE_WRITABLE));
+    CHECK(paging_large_pages() == large - 1);
+    CHECK(paging_get_physical(0x805000) == 0x7000);
+    CHECK(paging_get_physical(0x804000) == 0x804000);
+    CHECK(paging_get_physical(0x806000) == 0x806000);
+    CHECK(paging_map_page(0x805000, 0x805000, PAGE_WRITABLE | PAGE_GLOBAL));
+}
+
+static void test_tlb_stats(void) {
+    uintptr_t va = 0x803FE000;     // Straddles a page table boundary
+    paging_tlb_stats_t before = paging_get_tlb_stats();
+
+    // Entries that were not present need no invalidation
+    CHECK(paging_map_range(va, 0x1000000, 300, PAGE_WRITABLE));
+    for (size_t i = 0; i < 300; i++)
+        CHECK(paging_get_physical(va + i * PAGE_SIZE) == 0x1000000 + i * PAGE_SIZE);
+    paging_tlb_stats_t t = paging_get_tlb_stats();
+    CHECK(t.flushes_avoided - before.flushes_avoided == 300);
+    CHECK(t.invlpg == before.invlpg && t.full_flushes == before.full_flushes);
+
+    // Short changes are invalidated page by page, long ones in one flush
+    CHECK(paging_map_range(va, 0x2000000, 4, 0));
+    CHECK(paging_get_tlb_stats().invlpg - before.invlpg == 4);
+    CHECK(paging_unmap_range(va + PAGE_SIZE, 10) == 10);
+    CHECK(paging_get_tlb_stats().invlpg - before.invlpg == 14);
+    CHECK(paging_unmap_range(va, 400) == 290);
+    t = paging_get_tlb_stats();
+    CHECK(t.full_flushes - before.full_flushes == 1);
+    CHECK(t.flushes_avoided - before.flushes_avoided == 300 + 289);
+    CHECK(paging_get_physical(va) == 0);
+
+    paging_set_flush_threshold(1000);   // Clamped to PAGING_FLUSH_BATCH
+    CHECK(paging_map_range(va, 0x1000000, 64, 0));
+    CHECK(paging_map_range(va, 0x1000000, 64, 0));
+    CHECK(paging_get_tlb_stats().invlpg - before.invlpg == 14 + 64);
+    CHECK(paging_unmap_range(va, 64) == 64);
+    paging_set_flush_threshold(PAGING_FLUSH_THRESHOLD);
+}
+
+static void test_pat(void) {
+    CHECK(pat_written == PAT_EXPECTED);
+    uint32_t flags = PAGE_WRITABLE | PAGE_GLOBAL | PAGE_NOCACHE;
+    CHECK(paging_map_range_attr(0xB8000, 0xB8000, 8, flags, PAGING_ATTR_WC));
+    CHECK(paging_get_physical(0xB8000) == 0xB8000);
+    CHECK(paging_get_physical(0xB7000) == 0xB7000);
+    CHECK(paging_get_physical(0x100000) == 0x100000);
+    CHECK(paging_map_range_attr(0xFE902000, 0xFE902000, 1, PAGE_WRITABLE, PAGING_ATTR_UC));
+    CHECK(paging_get_physical(0xFE902000) == 0xFE902000);
+    CHECK(!paging_map_range_attr(0xFE902000, 0xFE902000, 1, PAGE_WRITABLE, PAGING_ATTR_UC + 1));
+}
+
+static void test_arenas(void) {
+    // An unaligned base must leave room for a whole page
+    CHECK(!vmm_arena_create(0x50000001, 0x10));
+    CHECK(!vmm_arena_create(0x50000001, 0x1000));
+    vmm_arena_t *arena = vmm_arena_create(0x50000001, 0x2000);
+    CHECK(arena && arena->pages == 1 && arena->base == 0x50001000);
+    CHECK(!vmm_arena_create(0x50001000, 0x1000));
+
+    void *p = vmm_arena_alloc(arena, PAGE_SIZE, PAGE_SIZE, 1, true);
+    CHECK(p == (void *)0x50001000);
+    vmm_free(p);
+    CHECK(vmm_arena_destroy(arena) == 0);
+}
+
+static void test_vmm_faults(void) {
+    size_t resident = vmm_get_fault_stats().resident_pages;
+    char *p = vmm_alloc(1 << 20);
+    CHECK(p);
+    for (size_t i = 0; i < 5; i++)
+        CHECK(vmm_handle_fault((uintptr_t)p + i * 2 * PAGE_SIZE, 2));
+    CHECK(paging_get_physical((uintptr_t)p) != 0);
+    vmm_free(p);
+    CHECK(vmm_get_fault_stats().resident_pages == resident);
+    CHECK(paging_get_physical((uintptr_t)p) == 0);
+}
+
+static void test_switch(void) {
+    size_t free_pages = pmm_get_stats().free_pages;
+    vm_space_stats_t before = vm_space_get_stats();
+
+    vm_space_t *a = vm_space_create(), *b = vm_space_create();
+    CHECK(a && b && a != b);
+    vm_space_switch(a);
+    CHECK(vm_space_current() == a && current_page_directory == a->root);
+
+    void *frame = pmm_alloc_page();
+    CHECK(paging_map_page(USER_BASE, (uintptr_t)frame, PAGE_WRITABLE | PAGE_USER));
+    CHECK(paging_get_physical(USER_BASE) == (uintptr_t)frame);
+
+    // Kernel mappings made in one space show in every space
+    char *p = vmm_alloc(1 << 20);
+    CHECK(vmm_handle_fault((uintptr_t)p, 2));
+    uintptr_t kernel_frame = paging_get_physical((uintptr_t)p);
+    CHECK(kernel_frame);
+
+    vm_space_switch(NULL);      // A kernel thread keeps the loaded space
+    CHECK(vm_space_current() == a);
+    vm_space_switch(b);
+    CHECK(paging_get_physical((uintptr_t)p) == kernel_frame);
+    CHECK(paging_get_physical(USER_BASE) == 0);
+    CHECK(paging_get_physical(0x123000) == 0x123000);
+    vm_space_switch(b);
+
+    // Four switches, two of them skipped
+    vm_space_stats_t st = vm_space_get_stats();
+    CHECK(st.switches - before.switches == 4);
+    CHECK(st.cr3_loads - before.cr3_loads == 2);
+    CHECK(st.lazy - before.lazy == 2);
+
+    vm_space_switch(vm_space_kernel());
+    CHECK(paging_get_physical((uintptr_t)p) == kernel_frame);
+    vmm_free(p);
+
+    CHECK(vm_space_destroy(a) == 0);
+    CHECK(pmm_page_lookup(frame)->refcount == 0);
+    CHECK(vm_space_destroy(b) == 0);
+    CHECK(vm_space_destroy(vm_space_kernel()) == -1);
+    CHECK(pmm_get_stats().free_pages == free_pages);
+}
+
+static void test_cow(void) {
+    size_t free_pages = pmm_get_stats().free_pages;
+    vm_space_stats_t before = vm_space_get_stats();
+
+    vm_space_t *a = vm_space_create();
+    CHECK(a);
+    vm_space_switch(a);
+    void *frame[3];
+    for (size_t i = 0; i < 3; i++) {
+        frame[i] = pmm_alloc_page();
+        uint32_t flags = PAGE_USER | (i < 2 ? PAGE_WRITABLE : 0);
+        CHECK(paging_map_page(USER_BASE + i * PAGE_SIZE, (uintptr_t)frame[i], flags));
+    }
+
+    vm_space_t *b = vm_space_clone(a);
+    CHECK(b);
+    CHECK(pmm_page_lookup(frame[0])->refcount == 2);
+    CHECK(pmm_page_lookup(frame[2])->refcount == 2);
+    CHECK(!vm_space_handle_cow(USER_BASE + 2 * PAGE_SIZE, 3));  // Read-only, not COW
+    CHECK(!vm_space_handle_cow(USER_BASE, 1));                  // Read fault
+
+    // The first writer copies, the last one takes the frame back
+    CHECK(vm_space_handle_cow(USER_BASE + 0x10, 3));
+    uintptr_t copy = paging_get_physical(USER_BASE);
+    CHECK(copy && copy != (uintptr_t)frame[0]);
+    CHECK(pmm_page_lookup(frame[0])->refcount == 1);
+    vm_space_switch(b);
+    CHECK(paging_get_physical(USER_BASE) == (uintptr_t)frame[0]);
+    CHECK(vm_space_handle_cow(USER_BASE, 3));
+    CHECK(paging_get_physical(USER_BASE) == (uintptr_t)frame[0]);
+
+    vm_space_stats_t st = vm_space_get_stats();
+    CHECK(st.cow_copies - before.cow_copies == 1);
+    CHECK(st.cow_reuses - before.cow_reuses == 1);
+
+    vm_space_switch(vm_space_kernel());
+    CHECK(vm_space_destroy(b) == 0);
+    CHECK(vm_space_destroy(a) == 0);
+    for (size_t i = 0; i < 3; i++) CHECK(pmm_page_lookup(frame[i])->refcount == 0);
+    CHECK(pmm_get_stats().free_pages == free_pages);
+}
+
+// paging_map_range() only maps 4 KB pages, so the large user entry is
+// written straight into the space's directory
+static void map_large_user(vm_space_t *space, uintptr_t va, uintptr_t phys) {
+    uint32_t flags = PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER | PAGE_LARGE;
+    if (use_pae) {
+        uint64_t *pdpt = (uint64_t *)space->root;
+        uint64_t *pd = (uint64_t *)(uintptr_t)(pdpt[va >> 30] & 0xFFFFF000);
+        pd[(va >> 21) & 0x1FF] = phys | flags;
+    } else {
+        ((uint32_t *)space->root)[va >> 22] = phys | flags;
+    }
+}
+
+// A large user page is split on clone, so both spaces share its frames
+// copy-on-write; a device frame outside the PMM is shared as it is
+static void test_clone_large(void) {
+    size_t big = use_pae ? PAGE_LARGE_SIZE_PAE : PAGE_LARGE_SIZE;
+    size_t free_pages = pmm_get_stats().free_pages;
+
+    vm_space_t *a = vm_space_create();
+    CHECK(a);
+    vm_space_switch(a);
+    char *run = pmm_alloc_constrained(big / PAGE_SIZE, PMM_ZONE_NORMAL, big, 0);
+    CHECK(run);
+    size_t large = paging_large_pages();
+    map_large_user(a, USER_BASE, (uintptr_t)run);
+    CHECK(paging_get_physical(USER_BASE + big - PAGE_SIZE) == (uintptr_t)run + big - PAGE_SIZE);
+    CHECK(paging_map_page(0x70000000, 0xE0000000, PAGE_WRITABLE | PAGE_USER));
+
+    vm_space_t *b = vm_space_clone(a);
+    CHECK(b);
+    CHECK(paging_large_pages() == large);
+    CHECK(pmm_page_lookup(run)->refcount == 2);
+    CHECK(pmm_page_lookup(run + big - PAGE_SIZE)->refcount == 2);
+    CHECK(paging_get_physical(USER_BASE) == (uintptr_t)run);
+
+    CHECK(vm_space_handle_cow(USER_BASE, 3));
+    CHECK(paging_get_physical(USER_BASE) != (uintptr_t)run);
+    CHECK(pmm_page_lookup(run)->refcount == 1);
+    vm_space_switch(b);
+    CHECK(vm_space_handle_cow(USER_BASE + PAGE_SIZE, 3));
+    CHECK(pmm_page_lookup(run + PAGE_SIZE)->refcount == 1);
+
+    vm_space_switch(vm_space_kernel());
+    CHECK(vm_space_destroy(b) == 0);
+    CHECK(pmm_page_lookup(run)->refcount == 0);
+    CHECK(pmm_page_lookup(run + PAGE_SIZE)->refcount == 1);
+    CHECK(vm_space_destroy(a) == 0);
+    CHECK(pmm_page_lookup(run + PAGE_SIZE)->refcount == 0);
+    CHECK(pmm_get_stats().free_pages == free_pages);
+}
+
+int main(int argc, char **argv) {
+    use_pae = argc > 1 && strcmp(argv[1], "pae") == 0;
+
+    bench_pmm_setup(REGION_PAGES);
+    void *user = mmap((void *)USER_BASE, USER_BYTES, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    CHECK(user == (void *)USER_BASE);
+
+    paging_init();
+    vmm_init();
+    CHECK(paging_get_mode() == (use_pae ? PAGING_PAE : PAGING_32BIT));
+
+    test_identity_map();
+    test_tlb_stats();
+    test_pat();
+    test_arenas();
+    test_vmm_faults();
+    test_switch();
+    test_cow();
+    test_clone_large();
+    printf("paging_test %s: ok\n", use_pae ? "pae" : "32-bit");
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Bulk allocation: pmm_alloc_bulk()/pmm_free_bulk() against a loop of
+// pmm_alloc_page_zone()/pmm_free_page() for batches of 256 pages, on an
+// empty region and on one with every other frame in use.
+#include "bench.h"
+#include <pmm.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REGION_PAGES 32512
+#define BATCH        256
+#define ROUNDS       2000
+
+typedef struct {
+    uint64_t alloc_ns;
+    uint64_t free_ns;
+} bulk_result_t;
+
+static bulk_result_t run_loop(void **pages) {
+    bulk_result_t r = { 0, 0 };
+    for (size_t round = 0; round < ROUNDS; round++) {
+        uint64_t t0 = bench_ns();
+        for (size_t i = 0; i < BATCH; i++) pages[i] = pmm_alloc_page_zone(PMM_ZONE_NORMAL);
+        uint64_t t1 = bench_ns();
+        for (size_t i = 0; i < BATCH; i++) pmm_free_page(pages[i]);
+        r.alloc_ns += t1 - t0;
+        r.free_ns += bench_ns() - t1;
+    }
+    return r;
+}
+
+static bulk_result_t run_bulk(void **pages) {
+    bulk_result_t r = { 0, 0 };
+    for (size_t round = 0; round < ROUNDS; round++) {
+        uint64_t t0 = bench_ns();
+        if (pmm_alloc_bulk(BATCH, pages, PMM_ZONE_NORMAL) != BATCH) {
+            fprintf(stderr, "pmm_bulk: short allocation\n");
+            exit(1);
+        }
+        uint64_t t1 = bench_ns();
+        pmm_free_bulk(pages, BATCH);
+        r.alloc_ns += t1 - t0;
+        r.free_ns += bench_ns() - t1;
+    }
+    return r;
+}
+
+static void report(const char *layout, bulk_result_t loop, bulk_result_t bulk) {
+    printf("%-11s alloc: loop %7.0f ns, bulk %7.0f ns (%.1fx)   "
+           "free: loop %7.0f ns, bulk %7.0f ns (%.1fx)\n", layout,
+           (double)loop.alloc_ns / ROUNDS, (double)bulk.alloc_ns / ROUNDS,
+           (double)loop.alloc_ns / bulk.alloc_ns,
+           (double)loop.free_ns / ROUNDS, (double)bulk.free_ns / ROUNDS,
+           (double)loop.free_ns / bulk.free_ns);
+}
+
+int main(void) {
+    bench_pmm_setup(REGION_PAGES);
+    static void *pages[BATCH];
+
+    printf("%d-page batches, mean of %d rounds\n", BATCH, ROUNDS);
+    bulk_result_t loop = run_loop(pages);
+    bulk_result_t bulk = run_bulk(pages);
+    report("empty", loop, bulk);
+
+    // Hold every other frame so no free run is longer than one page
+    static void *all[REGION_PAGES];
+    size_t n = pmm_alloc_bulk(REGION_PAGES, all, PMM_ZONE_NORMAL);
+    for (size_t i = 0; i < n; i += 2) pmm_free_page(all[i]);
+    pmm_drain_magazines();
+
+    loop = run_loop(pages);
+    bulk = run_bulk(pages);
+    report("fragmented", loop, bulk);
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Page coloring: conflict misses of a hot page set taken from a fragmented
+// PMM with pmm_alloc_page() and with pmm_alloc_page_color(). The cache is
+// simulated, not measured: an LRU set-associative model of the geometry
+// host.c reports, indexed by frame address as a physically indexed L2
+// would be. Host hardware counters would see the host's own physical
+// pages, not the PMM's.
+#include "bench.h"
+#include <pmm.h>
+#include <arch/i386/cpu.h>
+#include <stdio.h>
+#include <string.h>
+
+#define REGION_PAGES 8192
+#define HOT_PAGES    128        // 8 per color fills every way exactly
+#define HOT_LINES    16         // First 1 KB of each page: entries in use
+#define PASSES       100
+
+static cpu_cache_level_t geom;
+static uintptr_t cache_tags[4096][16];
+static uint32_t cache_age[4096][16];
+static uint32_t cache_clock;
+
+static void cache_reset(void) {
+    memset(cache_tags, 0, sizeof(cache_tags));
+    memset(cache_age, 0, sizeof(cache_age));
+    cache_clock = 0;
+}
+
+// Returns true on a miss
+static bool cache_access(uintptr_t addr) {
+    uintptr_t line = addr / geom.line_size;
+    size_t set = line % geom.sets;
+    size_t victim = 0;
+
+    cache_clock++;
+    for (size_t way = 0; way < geom.ways; way++) {
+        if (cache_tags[set][way] == line + 1) {
+            cache_age[set][way] = cache_clock;
+            return false;
+        }
+        if (cache_age[set][way] < cache_age[set][victim]) victim = way;
+    }
+    cache_tags[set][victim] = line + 1;
+    cache_age[set][victim] = cache_clock;
+    return true;
+}
+
+static size_t conflict_misses(void **pages) {
+    size_t misses = 0;
+    cache_reset();
+    for (size_t pass = 0; pass < PASSES; pass++) {
+        for (size_t p = 0; p < HOT_PAGES; p++) {
+            for (size_t l = 0; l < HOT_LINES; l++) {
+                misses += cache_access((uintptr_t)pages[p] + l * geom.line_size);
+            }
+        }
+    }
+    // The hot set is a quarter of the cache, so every miss after the first
+    // touch of each line is a conflict miss
+    return misses - HOT_PAGES * HOT_LINES;
+}
+
+// Leave a quarter of the region free in scattered frames, so allocation
+// order no longer follows address order
+static void fragment(void **all, size_t n) {
+    bench_srand(777);
+    for (size_t i = 0; i < n; i++) all[i] = pmm_alloc_page();
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = bench_rand() % (i + 1);
+        void *t = all[i];
+        all[i] = all[j];
+        all[j] = t;
+    }
+    for (size_t i = 0; i < n / 4; i++) {
+        pmm_free_page(all[i]);
+        all[i] = NULL;
+    }
+}
+
+int main(void) {
+    bench_pmm_setup(REGION_PAGES);
+    cpu_cache_info_t cache;
+    cpu_detect_cache(&cache);
+    geom = cache.l2;
+
+    static void *all[REGION_PAGES];
+    void *plain[HOT_PAGES], *colored[HOT_PAGES];
+    size_t n = pmm_get_stats().free_pages;
+    fragment(all, n);
+
+    for (size_t i = 0; i < HOT_PAGES; i++) plain[i] = pmm_alloc_page();
+    size_t plain_misses = conflict_misses(plain);
+    for (size_t i = 0; i < HOT_PAGES; i++) pmm_free_page(plain[i]);
+
+    unsigned hint = 0;
+    for (size_t i = 0; i < HOT_PAGES; i++) colored[i] = pmm_alloc_page_color(PMM_ZONE_NORMAL, &hint);
+    size_t colored_misses = conflict_misses(colored);
+
+    size_t accesses = (size_t)PASSES * HOT_PAGES * HOT_LINES;
+    printf("%u KB %u-way cache, %u colors, %d hot pages x %d lines x %d passes\n",
+           geom.size / 1024, geom.ways, pmm_color_count(), HOT_PAGES, HOT_LINES, PASSES);
+    printf("%-14s %8zu conflict misses (%.2f%%)\n", "uncolored", plain_misses,
+           100.0 * plain_misses / accesses);
+    printf("%-14s %8zu conflict misses (%.2f%%)\n", "colored", colored_misses,
+           100.0 * colored_misses / accesses);
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Contiguous allocation: the buddy allocator behind pmm_alloc_pages()
+// against the per-bit first-fit scan pmm.c used before it. Both replay the
+// same random mix of 1-32 page allocations and frees over a 127 MB region
+// held about half full.
+#include "bench.h"
+#include <pmm.h>
+#include <stdio.h>
+#include <string.h>
+
+#define REGION_PAGES 32512      // The 127 MB region init.c registers
+#define SLOTS        2048
+#define MAX_RUN      32
+#define OPS          50000
+
+// Reference: one bit per page, searched from the start for count free
+// bits in a row, exactly as the old pmm_alloc_pages_zone() did
+static uint64_t ref_bitmap[(REGION_PAGES + 63) / 64];
+
+static bool ref_test(size_t i) {
+    return ref_bitmap[i / 64] & (1ULL << (i % 64));
+}
+
+static void *ref_alloc(size_t count) {
+    size_t consecutive = 0, start = 0;
+    for (size_t i = 0; i < REGION_PAGES; i++) {
+        if (!ref_test(i)) {
+            if (consecutive == 0) start = i;
+            if (++consecutive == count) {
+                for (size_t j = start; j < start + count; j++)
+                    ref_bitmap[j / 64] |= 1ULL << (j % 64);
+                return (void *)(BENCH_PHYS_BASE + start * PMM_PAGE_SIZE);
+            }
+        } else {
+            consecutive = 0;
+        }
+    }
+    return NULL;
+}
+
+static int ref_free(void *addr, size_t count) {
+    size_t start = ((uintptr_t)addr - BENCH_PHYS_BASE) / PMM_PAGE_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        if (!ref_test(start + i)) return -1;
+    }
+    for (size_t i = start; i < start + count; i++)
+        ref_bitmap[i / 64] &= ~(1ULL << (i % 64));
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    void *(*alloc)(size_t count);
+    int (*free)(void *addr, size_t count);
+} contig_impl_t;
+
+static void run(const contig_impl_t *impl) {
+    static void *slot_addr[SLOTS];
+    static size_t slot_pages[SLOTS];
+    memset(slot_addr, 0, sizeof(slot_addr));
+
+    // Fill half the slots, then churn
+    bench_srand(12345);
+    for (size_t i = 0; i < SLOTS / 2; i++) {
+        slot_pages[i] = 1 + bench_rand() % MAX_RUN;
+        slot_addr[i] = impl->alloc(slot_pages[i]);
+    }
+
+    size_t failed = 0;
+    uint64_t t0 = bench_ns();
+    for (size_t op = 0; op < OPS; op++) {
+        size_t i = bench_rand() % SLOTS;
+        if (slot_addr[i]) {
+            impl->free(slot_addr[i], slot_pages[i]);
+            slot_addr[i] = NULL;
+        } else {
+            slot_pages[i] = 1 + bench_rand() % MAX_RUN;
+            slot_addr[i] = impl->alloc(slot_pages[i]);
+            if (!slot_addr[i]) failed++;
+        }
+    }
+    uint64_t elapsed = bench_ns() - t0;
+
+    for (size_t i = 0; i < SLOTS; i++) {
+        if (slot_addr[i]) impl->free(slot_addr[i], slot_pages[i]);
+    }
+    printf("%-14s %9.1f ns/op %8zu failed\n", impl->name, (double)elapsed / OPS, failed);
+}
+
+static void *pmm_alloc_run(size_t count) {
+    return pmm_alloc_pages(count);
+}
+
+int main(void) {
+    bench_pmm_setup(REGION_PAGES);
+
+    const contig_impl_t impls[] = {
+        { "bitmap scan", ref_alloc, ref_free },
+        { "buddy", pmm_alloc_run, pmm_free_pages },
+    };
+    printf("%d ops, 1-%d pages each, %d-page region\n", OPS, MAX_RUN, REGION_PAGES);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        run(&impls[i]);
+    }
+    return 0;
+}
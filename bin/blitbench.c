@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <paging.h>
+#include <vga.h>
+#include <arch/i386/cpu.h>
+
+#define BLITBENCH_DEFAULT_ROUNDS 1000
+#define BLITBENCH_CELLS (VGA_WIDTH * VGA_HEIGHT)
+
+static void print_usage(void) {
+    printf("Usage: blitbench [rounds]\n");
+    printf(" Time text buffer fills and scrolls as WC, UC and WB\n");
+}
+
+static uint16_t saved_screen[BLITBENCH_CELLS];
+
+// Every cell written once, as a clear or full redraw does
+static size_t time_fill(volatile uint16_t *screen, size_t rounds) {
+    uint64_t start = rdtsc();
+    for (size_t r = 0; r < rounds; r++) {
+        uint16_t cell = vga_entry((unsigned char)('a' + r % 26), 0x07);
+        for (size_t i = 0; i < BLITBENCH_CELLS; i++) screen[i] = cell;
+    }
+    return (size_t)((rdtsc() - start) / rounds);
+}
+
+// One line up and a blank bottom line, as vga_putchar() scrolls
+static size_t time_scroll(volatile uint16_t *screen, size_t rounds) {
+    uint16_t blank = vga_entry(' ', 0x07);
+    uint64_t start = rdtsc();
+    for (size_t r = 0; r < rounds; r++) {
+        memmove((void *)screen, (const void *)(screen + VGA_WIDTH),
+                sizeof(uint16_t) * VGA_WIDTH * (VGA_HEIGHT - 1));
+        for (size_t i = BLITBENCH_CELLS - VGA_WIDTH; i < BLITBENCH_CELLS; i++) screen[i] = blank;
+    }
+    return (size_t)((rdtsc() - start) / rounds);
+}
+
+int blitbench_main(int argc, char **argv) {
+    size_t rounds = BLITBENCH_DEFAULT_ROUNDS;
+
+    if (argc > 2) {
+        print_usage();
+        return 1;
+    }
+    if (argc == 2) {
+        char *end;
+        rounds = strtoul(argv[1], &end, 10);
+        if (*end != '\0' || rounds == 0) {
+            print_usage();
+            return 1;
+        }
+    }
+    if (paging_get_mode() == PAGING_OFF) {
+        printf("blitbench: paging is not enabled\n");
+        return 1;
+    }
+
+    static const struct {
+        const char *name;
+        paging_attr_t attr;
+    } types[] = {
+        { "WC", PAGING_ATTR_WC },
+        { "UC", PAGING_ATTR_UC },
+        { "WB", PAGING_ATTR_WB },
+    };
+    size_t fill[3], scroll[3];
+
+    // The first page of the text buffer holds the whole screen. It is
+    // remapped in place with the flags init gave it and left write-combining
+    // as init does.
+    uint32_t flags = PAGE_WRITABLE | PAGE_GLOBAL | PAGE_NX;
+    volatile uint16_t *screen = (volatile uint16_t *)VGA_TEXT_PHYS;
+    memcpy(saved_screen, (const void *)screen, sizeof(saved_screen));
+
+    for (size_t t = 0; t < 3; t++) {
+        if (!paging_map_range_attr(VGA_TEXT_PHYS, VGA_TEXT_PHYS, 1, flags, types[t].attr)) {
+            paging_map_range_attr(VGA_TEXT_PHYS, VGA_TEXT_PHYS, 1, flags, PAGING_ATTR_WC);
+            memcpy((void *)screen, saved_screen, sizeof(saved_screen));
+            printf("blitbench: cannot remap the text buffer %s\n", types[t].name);
+            return 1;
+        }
+        fill[t] = time_fill(screen, rounds);
+        scroll[t] = time_scroll(screen, rounds);
+    }
+
+    paging_map_range_attr(VGA_TEXT_PHYS, VGA_TEXT_PHYS, 1, flags, PAGING_ATTR_WC);
+    memcpy((void *)screen, saved_screen, sizeof(saved_screen));
+
+    cpu_features_t features;
+    cpu_detect_features(&features);
+    printf("%zu rounds over the %dx%d text buffer, cycles per operation\n",
+           rounds, VGA_WIDTH, VGA_HEIGHT);
+    if (!features.pat) printf("no PAT: WC falls back to UC\n");
+    printf("%-6s %10s %10s\n", "TYPE", "FILL", "SCROLL");
+    for (size_t t = 0; t < 3; t++) {
+        printf("%-6s %10zu %10zu\n", types[t].name, fill[t], scroll[t]);
+    }
+    return 0;
+}
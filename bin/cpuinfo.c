@@ -62,6 +62,16 @@ int cpuinfo_main(int argc, char **argv) {
     printf("HTT:         %s\n", features.htt ? "Yes" : "No");
     printf("POPCNT:      %s\n", features.popcnt ? "Yes" : "No");
     printf("XSAVE:       %s\n", features.xsave ? "Yes" : "No");
+
+    // Cache Geometry
+    cpu_cache_info_t cache;
+    cpu_detect_cache(&cache);
+
+    printf("\n-- Cache --\n");
+    printf("L2:          %u KB, %u-way, %u-byte lines\n",
+           cache.l2.size / 1024, cache.l2.ways, cache.l2.line_size);
+    printf("LLC (L%u):    %u KB, %u-way, %u-byte lines\n", cache.llc_level,
+           cache.llc.size / 1024, cache.llc.ways, cache.llc.line_size);
     
     return 0;
 }
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <shell.h>
 
 #define FONT_HEIGHT 7
 
@@ -492,7 +493,9 @@ static int char_to_index(char c) {
     }
 }
 
-char* join_args(int argc, char **argv) {
+// Scratch space comes from the shell's arena; when there is none or it
+// cannot grow, the string is malloc()ed and *heap tells the caller to free it
+char* join_args(int argc, char **argv, bool *heap) {
     // Calculate total length with spaces
     int total_len = 0;
     for (int i = 1; i < argc; i++) {
@@ -501,10 +504,15 @@ char* join_args(int argc, char **argv) {
             total_len++; // for space
     }
 
-    char *result = malloc(total_len + 1);
+    *heap = false;
+    char *result = arena_alloc(shell_arena(), total_len + 1);
     if (!result) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
+        result = malloc(total_len + 1);
+        if (!result) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return NULL;
+        }
+        *heap = true;
     }
 
     result[0] = '\0';  // start empty string
@@ -524,7 +532,9 @@ int figlet_main(int argc, char **argv) {
         return 0;
     }
 
-    char *text = join_args(argc, argv);
+    bool heap;
+    char *text = join_args(argc, argv, &heap);
+    if (!text) return 1;
 
     size_t len = strlen(text);
 
@@ -540,7 +550,7 @@ int figlet_main(int argc, char **argv) {
         printf("\n");
     }
 
-    free(text);
+    if (heap) free(text);
 
     return 0;
 }
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HEAPPROF_TOP    10
+#define HEAPPROF_RECENT 16
+
+static void print_usage(void) {
+    printf("Usage: heapprof [-c | -r | -z]\n");
+    printf(" (none) Top allocation sites by bytes\n");
+    printf(" -c     Top allocation sites by count\n");
+    printf(" -r     Most recent samples\n");
+    printf(" -z     Clear the profile\n");
+}
+
+static int print_recent(void) {
+    malloc_sample_t samples[HEAPPROF_RECENT];
+    size_t n = malloc_profile_samples(samples, HEAPPROF_RECENT);
+    uint64_t now = rdtsc();
+
+    printf("%-12s %10s %14s\n", "SITE", "SIZE", "KCYCLES AGO");
+    for (size_t i = 0; i < n; i++) {
+        printf("%p %10zu %14zu\n", samples[i].site, samples[i].size,
+               (size_t)((now - samples[i].tsc) >> 10));
+    }
+    return 0;
+}
+
+int heapprof_main(int argc, char **argv) {
+    bool by_count = false;
+
+    if (argc > 2) {
+        print_usage();
+        return 1;
+    }
+    if (argc == 2) {
+        if (strcmp(argv[1], "-c") == 0) {
+            by_count = true;
+        } else if (strcmp(argv[1], "-r") == 0) {
+            return print_recent();
+        } else if (strcmp(argv[1], "-z") == 0) {
+            malloc_profile_reset();
+            return 0;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    malloc_site_t top[HEAPPROF_TOP];
+    size_t n = malloc_profile_sites(top, HEAPPROF_TOP, by_count);
+    if (n == 0) {
+        printf("heapprof: no samples (kernel built without MALLOC_PROFILE?)\n");
+        return 1;
+    }
+
+    printf("%-12s %12s %10s %8s\n", "SITE", "~BYTES", "~COUNT", "SAMPLES");
+    for (size_t i = 0; i < n && i < HEAPPROF_TOP; i++) {
+        printf("%p %12zu %10zu %8zu\n", top[i].site, top[i].bytes, top[i].count,
+               top[i].samples);
+    }
+    if (malloc_profile_dropped() > 0) {
+        printf("%zu samples from untracked sites\n", malloc_profile_dropped());
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <paging.h>
+
+#define VMSWITCH_DEFAULT_ROUNDS 10000
+
+static void print_usage(void) {
+    printf("Usage: vmswitch [rounds]\n");
+    printf(" Time address-space switches against full CR3 reloads\n");
+}
+
+// Average cycles of one step over rounds steps
+static size_t per_round(uint64_t start, uint64_t end, size_t rounds) {
+    return (size_t)((end - start) / rounds);
+}
+
+// Alternate between two spaces, so every switch loads CR3
+static size_t time_switches(vm_space_t *a, vm_space_t *b, size_t rounds) {
+    uint64_t start = rdtsc();
+    for (size_t i = 0; i < rounds; i += 2) {
+        vm_space_switch(a);
+        vm_space_switch(b);
+    }
+    return per_round(start, rdtsc(), rounds);
+}
+
+// Switch to the space already loaded: the switch is skipped
+static size_t time_lazy(vm_space_t *a, size_t rounds) {
+    vm_space_switch(a);
+    uint64_t start = rdtsc();
+    for (size_t i = 0; i < rounds; i++) vm_space_switch(a);
+    return per_round(start, rdtsc(), rounds);
+}
+
+// Write CR3 back unconditionally, as every switch did before lazy switching
+static size_t time_reloads(size_t rounds) {
+    uint64_t start = rdtsc();
+    for (size_t i = 0; i < rounds; i++) {
+        uint32_t cr3;
+        asm volatile("mov %%cr3, %0" : "=r"(cr3));
+        asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+    }
+    return per_round(start, rdtsc(), rounds);
+}
+
+int vmswitch_main(int argc, char **argv) {
+    size_t rounds = VMSWITCH_DEFAULT_ROUNDS;
+
+    if (argc > 2) {
+        print_usage();
+        return 1;
+    }
+    if (argc == 2) {
+        char *end;
+        rounds = strtoul(argv[1], &end, 10);
+        if (*end != '\0' || rounds < 2) {
+            print_usage();
+            return 1;
+        }
+        rounds &= ~(size_t)1;   // Whole a-b pairs
+    }
+    if (paging_get_mode() == PAGING_OFF) {
+        printf("vmswitch: paging is not enabled\n");
+        return 1;
+    }
+
+    vm_space_t *home = vm_space_current();
+    vm_space_t *a = vm_space_create();
+    vm_space_t *b = vm_space_create();
+    if (!a || !b) {
+        printf("vmswitch: cannot create address spaces\n");
+        if (a) vm_space_destroy(a);
+        return 1;
+    }
+
+    vm_space_stats_t before = vm_space_get_stats();
+    size_t switch_cycles = time_switches(a, b, rounds);
+    size_t lazy_cycles = time_lazy(a, rounds);
+    size_t reload_cycles = time_reloads(rounds);
+    vm_space_stats_t after = vm_space_get_stats();
+
+    vm_space_switch(home);
+    vm_space_destroy(a);
+    vm_space_destroy(b);
+
+    printf("%zu rounds, cycles per operation\n", rounds);
+    printf("%-22s %8zu\n", "switch a<->b", switch_cycles);
+    printf("%-22s %8zu\n", "switch to loaded", lazy_cycles);
+    printf("%-22s %8zu\n", "CR3 reload", reload_cycles);
+
+    printf("\n%-12s %10s %10s\n", "COUNTER", "RUN", "TOTAL");
+    printf("%-12s %10zu %10zu\n", "switches", after.switches - before.switches, after.switches);
+    printf("%-12s %10zu %10zu\n", "cr3_loads", after.cr3_loads - before.cr3_loads, after.cr3_loads);
+    printf("%-12s %10zu %10zu\n", "lazy", after.lazy - before.lazy, after.lazy);
+    printf("%-12s %10zu %10zu\n", "cow_copies", after.cow_copies - before.cow_copies, after.cow_copies);
+    printf("%-12s %10zu %10zu\n", "cow_reuses", after.cow_reuses - before.cow_reuses, after.cow_reuses);
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include <pmm.h>
 
 static const char kb_scancode_to_ascii[256] = {
     0, 27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
@@ -188,7 +189,9 @@ char kb_getchar(void) {
     if (!kb_state.input_enabled) return 0;
 
     while (1) {
+        // Waiting for a key is the idle loop: prepare zeroed pages meanwhile
         while ((inb(KB_STATUS_PORT) & 0x01) == 0) {
+            pmm_idle_zero();
             asm volatile("pause");
         }
 
@@ -4,6 +4,7 @@
 #include <vga.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <kmem.h>
 
 #define CMD_COL_WIDTH 18
 #define DESC_COL_WIDTH 45
@@ -11,6 +12,9 @@
 // Global shell context for built-in commands
 static shell_context_t *g_shell_ctx = NULL;
 
+// History entries come from their own slab cache
+static kmem_cache_t *history_cache = NULL;
+
 // External declarations
 extern shell_command_t shell_commands[];
 extern size_t shell_commands_count;
@@ -251,6 +255,7 @@ int exit_main(int argc, char **argv) {
 // Enhanced shell command list
 shell_command_t shell_commands[] = {
     { "bc",       "Launch a basic calculator",                 bc_main       },
+    { "blitbench", "Time text buffer blits by memory type",     blitbench_main },
     { "cat",      "Display the contents of a file",            cat_main      },
     { "cd",       "Change the current directory",              cd_main       },
     { "cp",       "Copy a file to a destination",              cp_main       },
@@ -264,6 +269,7 @@ shell_command_t shell_commands[] = {
     { "factor",   "Show the prime factors of a number",        factor_main   },
     { "fetch",    "Display system information",                fetch_main    },
     { "figlet",   "Transform normal text into ASCII art",      figlet_main   },
+    { "heapprof", "Show the top heap allocation sites",        heapprof_main },
     { "help",     "Show this help message",                    help_main     },
     { "history",  "Show command history",                      history_main  },
     { "ls",       "List files in the current directory",       ls_main       },
@@ -280,6 +286,7 @@ shell_command_t shell_commands[] = {
     { "touch",    "Create an empty file",                      touch_main    },
     { "tty",      "Show the current terminal",                 tty_main      },
     { "uname",    "Show system name and version",              uname_main    },
+    { "vmswitch", "Time address-space switches",               vmswitch_main },
     { "whoami",   "Display the current user",                  whoami_main   },
     { "yes",      "Repeat a string endlessly",                 yes_main      },
 };
@@ -300,6 +307,9 @@ void shell_init(shell_context_t *ctx, shell_command_t *commands, size_t num_comm
     
     // Initialize the history queue
     TAILQ_INIT(&ctx->history_head);
+    if (!history_cache)
+        history_cache = kmem_cache_create("history_entry", sizeof(history_entry_t), 0, NULL);
+    ctx->arena = arena_create();
     
     // Set global context for built-in commands
     g_shell_ctx = ctx;
@@ -315,11 +325,14 @@ void shell_cleanup(shell_context_t *ctx) {
     
     TAILQ_FOREACH_SAFE(entry, &ctx->history_head, entries, tmp) {
         TAILQ_REMOVE(&ctx->history_head, entry, entries);
-        free(entry);
+        kmem_cache_free(history_cache, entry);
     }
     
     ctx->history_count = 0;
     ctx->history_current = NULL;
+
+    arena_destroy(ctx->arena);
+    ctx->arena = NULL;
 }
 
 // Add command to history using TAILQ
@@ -337,11 +350,12 @@ void shell_add_to_history(shell_context_t *ctx, const char *command) {
     if (ctx->history_count >= SHELL_HISTORY_SIZE) {
         history_entry_t *oldest = TAILQ_FIRST(&ctx->history_head);
         TAILQ_REMOVE(&ctx->history_head, oldest, entries);
-        free(oldest);
+        kmem_cache_free(history_cache, oldest);
         ctx->history_count--;
     }
 
-    history_entry_t *new_entry = malloc(sizeof(history_entry_t));
+    if (!history_cache) return;
+    history_entry_t *new_entry = kmem_cache_alloc(history_cache);
     if (!new_entry) return;
 
     // Use strncpy to avoid buffer overflow
@@ -614,7 +628,15 @@ int shell_execute(shell_context_t *ctx, int argc, char **argv) {
     // Search for command
     for (size_t i = 0; i < ctx->num_commands; i++) {
         if (strcmp(argv[0], ctx->commands[i].name) == 0) {
-            return ctx->commands[i].func(argc, argv);
+            if (!ctx->arena) {
+                return ctx->commands[i].func(argc, argv);
+            }
+
+            // Whatever the command took from shell_arena() goes at once
+            arena_mark_t mark = arena_mark(ctx->arena);
+            int status = ctx->commands[i].func(argc, argv);
+            arena_reset(ctx->arena, mark);
+            return status;
         }
     }
 
@@ -623,6 +645,11 @@ int shell_execute(shell_context_t *ctx, int argc, char **argv) {
     return 127; // Standard "command not found" exit code
 }
 
+// Scratch arena of the running command, NULL if the shell has none
+arena_t *shell_arena(void) {
+    return g_shell_ctx ? g_shell_ctx->arena : NULL;
+}
+
 // Enhanced error message
 void shell_print_not_found(const char *command) {
     vga_puts("shell: ");
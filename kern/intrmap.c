@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <kmem.h>
 #include <sys/intrmap.h>
 
 struct device;
@@ -14,11 +15,21 @@ struct intrmap {
     struct cpu_info **cpus;
 };
 
+static kmem_cache_t *intrmap_cache;
+static kmem_cache_t *cpu_info_cache;
+
 struct intrmap *
 intrmap_create(const struct device *device, unsigned int flags,
                unsigned int cpu_count, unsigned int cpu_base_id)
 {
-    struct intrmap *im = malloc(sizeof(*im));
+    if (!intrmap_cache)
+        intrmap_cache = kmem_cache_create("intrmap", sizeof(struct intrmap), 0, NULL);
+    if (!cpu_info_cache)
+        cpu_info_cache = kmem_cache_create("cpu_info", sizeof(struct cpu_info), 0, NULL);
+    if (!intrmap_cache || !cpu_info_cache)
+        return NULL;
+
+    struct intrmap *im = kmem_cache_alloc(intrmap_cache);
     if (!im)
         return NULL;
 
@@ -28,17 +39,17 @@ intrmap_create(const struct device *device, unsigned int flags,
 
     im->cpus = malloc(sizeof(*im->cpus) * cpu_count);
     if (!im->cpus) {
-        free(im);
+        kmem_cache_free(intrmap_cache, im);
         return NULL;
     }
 
     for (unsigned int i = 0; i < cpu_count; i++) {
-        im->cpus[i] = malloc(sizeof(struct cpu_info));
+        im->cpus[i] = kmem_cache_alloc(cpu_info_cache);
         if (!im->cpus[i]) {
             while (i--)
-                free(im->cpus[i]);
+                kmem_cache_free(cpu_info_cache, im->cpus[i]);
             free(im->cpus);
-            free(im);
+            kmem_cache_free(intrmap_cache, im);
             return NULL;
         }
         im->cpus[i]->cpu_id = cpu_base_id + i;
@@ -54,10 +65,10 @@ intrmap_destroy(struct intrmap *im)
         return;
 
     for (unsigned int i = 0; i < im->cpu_count; i++)
-        free(im->cpus[i]);
+        kmem_cache_free(cpu_info_cache, im->cpus[i]);
 
     free(im->cpus);
-    free(im);
+    kmem_cache_free(intrmap_cache, im);
 }
 
 unsigned int
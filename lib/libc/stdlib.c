@@ -3,6 +3,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <string.h>
+#include <pmm.h>
+#ifdef MALLOC_PROFILE
+#include <time.h>
+#endif
 
 // Forward declarations for static functions
 static size_t partition(char* base, size_t low, size_t high, size_t size,
@@ -12,65 +17,434 @@ static void swap_elements(void* a, void* b, size_t size);
 // Static variables for memory management and random number generation
 static unsigned long next_rand = 1;
 
-// Simple heap management
-// This is a basic implementation
-extern void* _sbrk(intptr_t increment);  // System call to extend heap
-extern char end;        // Provided by linker script
-static char* heap_end = &end;
+// Heap management
+//
+// Chunks carry a boundary tag: a size word whose low bits say whether the
+// chunk and its predecessor are in use, and, while the predecessor is
+// free, its size in the word before. Free chunks sit on segregated lists:
+// one per 8-byte size below MALLOC_SMALL_MAX, then four per power of two.
+// A bitmap of non-empty lists finds the smallest fitting one without a
+// scan. Freeing merges a chunk with free neighbours on both sides.
+//
+// The heap grows in segments of at least MALLOC_SEGMENT_SIZE, taken from
+// the PMM once it is up and from the fixed boot heap (_sbrk) before. Requests
+// of MALLOC_SPAN_THRESHOLD and more get whole pages of their own, which go
+// straight back to the PMM on free; so does a PMM segment that becomes
+// entirely free while enough other free space remains.
+#define MALLOC_BOOT_HEAP_SIZE (128 * 1024)
+
+// Lives in .bss, below _kernel_end, so the PMM never hands it out
+static char boot_heap[MALLOC_BOOT_HEAP_SIZE] __attribute__((aligned(PMM_PAGE_SIZE)));
+static char* heap_end = boot_heap;
 
 void* _sbrk(intptr_t incr) {
+    size_t used = heap_end - boot_heap;
+    if (incr > 0 ? (size_t)incr > MALLOC_BOOT_HEAP_SIZE - used : (size_t)-incr > used)
+        return (void*)-1;
+
     char* prev_heap_end = heap_end;
     heap_end += incr;
     return (void*) prev_heap_end;
 }
 
+#define MALLOC_ALIGN          8
+#define MALLOC_HEADER         (2 * sizeof(size_t))
+#define MALLOC_MIN_CHUNK      (MALLOC_HEADER + 2 * sizeof(void*))
+#define MALLOC_SMALL_MAX      256
+#define MALLOC_BINS           64
+#define MALLOC_SEGMENT_SIZE   (64 * 1024)
+#define MALLOC_SPAN_THRESHOLD (32 * 1024)
+#define MALLOC_OWNER_TAG      0x4D414C43   // "MALC" in the page database
+
+#define CHUNK_INUSE       0x1
+#define CHUNK_PREV_INUSE  0x2
+#define CHUNK_SPAN        0x4   // Own pages from the PMM
+#define CHUNK_FLAGS       0x7
+
+// prev_size of the first chunk of a PMM segment. Real sizes are multiples
+// of 8 and split remainders start at 0, so this cannot occur otherwise.
+#define SEGMENT_FROM_PMM  1
+
+typedef struct malloc_chunk {
+    size_t prev_size;       // Size of the previous chunk, valid while it is free
+    size_t size;            // Chunk size including this header, plus flags
+    struct malloc_chunk* next;  // Free list links, valid while free
+    struct malloc_chunk* prev;
+} malloc_chunk_t;
+
+static malloc_chunk_t* bins[MALLOC_BINS];
+static uint32_t binmap[MALLOC_BINS / 32];
+static size_t heap_free_bytes;
+
+static inline size_t chunk_size(const malloc_chunk_t* c) {
+    return c->size & ~(size_t)CHUNK_FLAGS;
+}
+
+static inline malloc_chunk_t* chunk_next(malloc_chunk_t* c) {
+    return (malloc_chunk_t*)((char*)c + chunk_size(c));
+}
+
+static inline malloc_chunk_t* mem_to_chunk(void* mem) {
+    return (malloc_chunk_t*)((char*)mem - MALLOC_HEADER);
+}
+
+static inline void* chunk_to_mem(malloc_chunk_t* c) {
+    return (char*)c + MALLOC_HEADER;
+}
+
+static unsigned bin_index(size_t size) {
+    if (size < MALLOC_SMALL_MAX) return size >> 3;
+
+    unsigned log = 31 - __builtin_clz(size);
+    unsigned index = 32 + ((log - 8) << 2) + ((size >> (log - 2)) & 3);
+    return index < MALLOC_BINS ? index : MALLOC_BINS - 1;
+}
+
+static void bin_insert(malloc_chunk_t* c) {
+    unsigned i = bin_index(chunk_size(c));
+    c->prev = NULL;
+    c->next = bins[i];
+    if (bins[i]) bins[i]->prev = c;
+    bins[i] = c;
+    binmap[i >> 5] |= 1u << (i & 31);
+    heap_free_bytes += chunk_size(c);
+}
+
+static void bin_remove(malloc_chunk_t* c) {
+    unsigned i = bin_index(chunk_size(c));
+    if (c->prev) c->prev->next = c->next;
+    else bins[i] = c->next;
+    if (c->next) c->next->prev = c->prev;
+    if (!bins[i]) binmap[i >> 5] &= ~(1u << (i & 31));
+    heap_free_bytes -= chunk_size(c);
+}
+
+// Mark a chunk free: record its size in the successor and clear the
+// successor's PREV_INUSE, then file it
+static void chunk_release(malloc_chunk_t* c, size_t size) {
+    c->size = size | (c->size & CHUNK_PREV_INUSE);
+    malloc_chunk_t* next = chunk_next(c);
+    next->prev_size = size;
+    next->size &= ~(size_t)CHUNK_PREV_INUSE;
+    bin_insert(c);
+}
+
+// Make c an in-use chunk of need out of its size bytes, freeing the tail
+// (merged with a free successor) when it is big enough to be a chunk
+static void chunk_trim(malloc_chunk_t* c, size_t size, size_t need) {
+    if (size - need >= MALLOC_MIN_CHUNK) {
+        c->size = need | CHUNK_INUSE | (c->size & CHUNK_PREV_INUSE);
+        malloc_chunk_t* rest = chunk_next(c);
+        rest->prev_size = 0;
+        rest->size = CHUNK_PREV_INUSE;
+
+        size_t rest_size = size - need;
+        malloc_chunk_t* next = (malloc_chunk_t*)((char*)rest + rest_size);
+        if (!(next->size & CHUNK_INUSE)) {
+            bin_remove(next);
+            rest_size += chunk_size(next);
+        }
+        chunk_release(rest, rest_size);
+    } else {
+        c->size = size | CHUNK_INUSE | (c->size & CHUNK_PREV_INUSE);
+        chunk_next(c)->size |= CHUNK_PREV_INUSE;
+    }
+}
+
+// Hand out the first need bytes of free chunk c, filing the remainder
+static void* chunk_take(malloc_chunk_t* c, size_t need) {
+    bin_remove(c);
+    chunk_trim(c, chunk_size(c), need);
+    return chunk_to_mem(c);
+}
+
+// Chunk size for a request of size bytes
+static size_t chunk_need(size_t size) {
+    size_t need = (size + MALLOC_HEADER + MALLOC_ALIGN - 1) & ~(size_t)(MALLOC_ALIGN - 1);
+    return need < MALLOC_MIN_CHUNK ? MALLOC_MIN_CHUNK : need;
+}
+
+// Smallest free chunk of at least need bytes, or NULL
+static malloc_chunk_t* bin_find(size_t need) {
+    unsigned i = bin_index(need);
+
+    // Lists above the small range mix sizes; only the first needs a scan
+    if (i >= 32) {
+        for (malloc_chunk_t* c = bins[i]; c; c = c->next)
+            if (chunk_size(c) >= need) return c;
+        i++;
+    }
+
+    for (unsigned w = i >> 5; w < MALLOC_BINS / 32; w++) {
+        uint32_t bits = binmap[w];
+        if (w == i >> 5) bits &= ~0u << (i & 31);
+        if (bits) return bins[(w << 5) + __builtin_ctz(bits)];
+    }
+    return NULL;
+}
+
+static void* heap_pages(size_t bytes, bool* from_pmm) {
+    void* pages = pmm_alloc_pages(bytes / PMM_PAGE_SIZE);
+    *from_pmm = pages != NULL;
+    if (pages) {
+        pmm_page_set_owner(pages, bytes / PMM_PAGE_SIZE, MALLOC_OWNER_TAG);
+        return pages;
+    }
+
+    // Only early allocations, made before the PMM is up, use the boot heap
+    if (pmm_get_stats().total_pages > 0) return NULL;
+
+    uintptr_t brk = (uintptr_t)_sbrk(0);
+    uintptr_t pad = (MALLOC_ALIGN - (brk & (MALLOC_ALIGN - 1))) & (MALLOC_ALIGN - 1);
+    char* base = _sbrk(pad + bytes);
+    if (base == (void*)-1) return NULL;
+    return base + pad;
+}
+
+// Add a segment able to hold a chunk of need bytes. It ends in a zero-size
+// in-use fencepost so merging never runs off the end.
+static bool heap_grow(size_t need) {
+    size_t bytes = need + MALLOC_HEADER;
+    if (bytes < MALLOC_SEGMENT_SIZE) bytes = MALLOC_SEGMENT_SIZE;
+    bytes = (bytes + PMM_PAGE_SIZE - 1) & ~(size_t)(PMM_PAGE_SIZE - 1);
+
+    bool from_pmm;
+    char* base = heap_pages(bytes, &from_pmm);
+    if (!base) return false;
+
+    malloc_chunk_t* fence = (malloc_chunk_t*)(base + bytes - MALLOC_HEADER);
+    fence->size = CHUNK_INUSE;
+
+    malloc_chunk_t* c = (malloc_chunk_t*)base;
+    c->prev_size = from_pmm ? SEGMENT_FROM_PMM : 0;
+    c->size = CHUNK_PREV_INUSE;
+    chunk_release(c, bytes - MALLOC_HEADER);
+    return true;
+}
+
+#ifdef MALLOC_PROFILE
+// Heap profiler. Allocations are sampled by volume: sample points fall on
+// the stream of requested bytes at random gaps averaging
+// MALLOC_PROFILE_INTERVAL, and a request covering one or more of them is
+// charged to its caller in a fixed open-addressed table of sites and
+// logged, with a TSC timestamp, in a ring of recent samples. Each point
+// stands for an interval's worth of bytes, and for interval / size
+// requests of its size; random gaps keep periodic allocation patterns
+// from always landing the points on the same site. The common path is one
+// compare and one subtraction. Without MALLOC_PROFILE none of this is
+// compiled and the hooks expand to nothing.
+typedef struct {
+    void* site;
+    size_t bytes;
+    uint64_t count;     // Estimated allocations, in 1/256ths
+    size_t samples;
+} prof_site_t;
+
+static prof_site_t prof_sites[MALLOC_PROFILE_SITES];
+static malloc_sample_t prof_ring[MALLOC_PROFILE_SAMPLES];
+static size_t prof_next;
+static size_t prof_dropped;     // Samples from sites the table had no room for
+static size_t prof_countdown = MALLOC_PROFILE_INTERVAL;
+static uint32_t prof_seed = 2463534242u;
+
+// Gap to the next sample point, uniform in [1, 2 * interval)
+static size_t profile_gap(void) {
+    prof_seed ^= prof_seed << 13;
+    prof_seed ^= prof_seed >> 17;
+    prof_seed ^= prof_seed << 5;
+    return 1 + prof_seed % (2 * MALLOC_PROFILE_INTERVAL - 1);
+}
+
+static void profile_record(void* site, size_t size) {
+    size_t points = 0;
+    size_t left = size;
+    while (left >= prof_countdown) {
+        left -= prof_countdown;
+        prof_countdown = profile_gap();
+        points++;
+    }
+    prof_countdown -= left;
+
+    malloc_sample_t* s = &prof_ring[prof_next++ % MALLOC_PROFILE_SAMPLES];
+    s->site = site;
+    s->size = size;
+    s->tsc = rdtsc();
+
+    size_t h = ((uintptr_t)site * 2654435761u) % MALLOC_PROFILE_SITES;
+    for (size_t probe = 0; probe < MALLOC_PROFILE_SITES; probe++) {
+        prof_site_t* e = &prof_sites[(h + probe) % MALLOC_PROFILE_SITES];
+        if (e->site != site && e->site) continue;
+        e->site = site;
+        e->bytes += points * MALLOC_PROFILE_INTERVAL;
+        e->count += ((uint64_t)points * MALLOC_PROFILE_INTERVAL << 8) / size;
+        e->samples++;
+        return;
+    }
+    prof_dropped++;
+}
+
+#define PROFILE_RECORD(size) do {                                   \
+        size_t bytes_ = (size);                                     \
+        if (bytes_ >= prof_countdown)                               \
+            profile_record(__builtin_return_address(0), bytes_);    \
+        else                                                        \
+            prof_countdown -= bytes_;                               \
+    } while (0)
+
+static bool site_ranks_above(const prof_site_t* a, const malloc_site_t* b, bool by_count) {
+    return by_count ? (a->count >> 8) > b->count : a->bytes > b->bytes;
+}
+
+size_t malloc_profile_sites(malloc_site_t* out, size_t max, bool by_count) {
+    size_t n = 0;
+    for (size_t i = 0; i < MALLOC_PROFILE_SITES; i++) {
+        const prof_site_t* e = &prof_sites[i];
+        if (!e->site) continue;
+
+        // Insertion into the sorted top-max list
+        size_t j = n < max ? n++ : max;
+        while (j > 0 && site_ranks_above(e, &out[j - 1], by_count)) {
+            if (j < max) out[j] = out[j - 1];
+            j--;
+        }
+        if (j < max) {
+            out[j].site = e->site;
+            out[j].bytes = e->bytes;
+            out[j].count = (size_t)((e->count + 128) >> 8);
+            out[j].samples = e->samples;
+        }
+    }
+    return n;
+}
+
+size_t malloc_profile_samples(malloc_sample_t* out, size_t max) {
+    size_t n = 0;
+    size_t avail = prof_next < MALLOC_PROFILE_SAMPLES ? prof_next : MALLOC_PROFILE_SAMPLES;
+    while (n < max && n < avail) {
+        out[n] = prof_ring[(prof_next - 1 - n) % MALLOC_PROFILE_SAMPLES];
+        n++;
+    }
+    return n;
+}
+
+size_t malloc_profile_dropped(void) {
+    return prof_dropped;
+}
+
+void malloc_profile_reset(void) {
+    memset(prof_sites, 0, sizeof(prof_sites));
+    prof_next = 0;
+    prof_dropped = 0;
+    prof_countdown = profile_gap();
+}
+#else
+#define PROFILE_RECORD(size) ((void)0)
+
+size_t malloc_profile_sites(malloc_site_t* out, size_t max, bool by_count) {
+    (void)out;
+    (void)max;
+    (void)by_count;
+    return 0;
+}
+
+size_t malloc_profile_samples(malloc_sample_t* out, size_t max) {
+    (void)out;
+    (void)max;
+    return 0;
+}
+
+size_t malloc_profile_dropped(void) {
+    return 0;
+}
+
+void malloc_profile_reset(void) {
+}
+#endif
+
+static void* heap_alloc(size_t size) {
+    if (size == 0 || size > SIZE_MAX - PMM_PAGE_SIZE - MALLOC_HEADER) return NULL;
+
+    size_t need = chunk_need(size);
+    if (need >= MALLOC_SPAN_THRESHOLD) {
+        size_t pages = (need + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+        malloc_chunk_t* c = pmm_alloc_pages(pages);
+        if (c) {
+            pmm_page_set_owner(c, pages, MALLOC_OWNER_TAG);
+            c->size = pages * PMM_PAGE_SIZE | CHUNK_INUSE | CHUNK_SPAN;
+            return chunk_to_mem(c);
+        }
+    }
+
+    malloc_chunk_t* c = bin_find(need);
+    if (!c) {
+        if (!heap_grow(need)) return NULL;
+        c = bin_find(need);
+    }
+    return chunk_take(c, need);
+}
+
 // Memory management functions
 void* malloc(size_t size) {
-    // Basic implementation
-    if (size == 0) return NULL;
-    
-    // Align size to pointer boundary
-    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
-    
-    void* ptr = _sbrk(size + sizeof(size_t));
-    if (ptr == (void*)-1) return NULL;
-    
-    *(size_t*)ptr = size;
-    return (char*)ptr + sizeof(size_t);
+    void* ptr = heap_alloc(size);
+    if (ptr) PROFILE_RECORD(size);
+    return ptr;
 }
 
 void* calloc(size_t num, size_t size) {
     size_t total_size = num * size;
     if (num != 0 && total_size / num != size) return NULL; // Overflow check
     
-    void* ptr = malloc(total_size);
+    void* ptr = heap_alloc(total_size);
     if (ptr) {
-        char* p = (char*)ptr;
-        for (size_t i = 0; i < total_size; i++) {
-            p[i] = 0;
-        }
+        PROFILE_RECORD(total_size);
+        memset(ptr, 0, total_size);
     }
     return ptr;
 }
 
 void* realloc(void* ptr, size_t size) {
-    if (!ptr) return malloc(size);
+    if (!ptr) {
+        ptr = heap_alloc(size);
+        if (ptr) PROFILE_RECORD(size);
+        return ptr;
+    }
     if (size == 0) {
         free(ptr);
         return NULL;
     }
     
-    size_t old_size = *((size_t*)((char*)ptr - sizeof(size_t)));
-    void* new_ptr = malloc(size);
-    if (!new_ptr) return NULL;
-    
-    size_t copy_size = (old_size < size) ? old_size : size;
-    char* src = (char*)ptr;
-    char* dst = (char*)new_ptr;
-    for (size_t i = 0; i < copy_size; i++) {
-        dst[i] = src[i];
+    if (size > SIZE_MAX - PMM_PAGE_SIZE - MALLOC_HEADER) return NULL;
+
+    malloc_chunk_t* c = mem_to_chunk(ptr);
+    size_t old_size = chunk_size(c) - MALLOC_HEADER;
+
+    // Shrink in place, or grow into a free successor
+    if (!(c->size & CHUNK_SPAN)) {
+        size_t need = chunk_need(size);
+        size_t avail = chunk_size(c);
+        malloc_chunk_t* next = chunk_next(c);
+        if (avail < need && !(next->size & CHUNK_INUSE) && avail + chunk_size(next) >= need) {
+            bin_remove(next);
+            avail += chunk_size(next);
+        }
+        if (avail >= need) {
+            chunk_trim(c, avail, need);
+            if (size > old_size) PROFILE_RECORD(size - old_size);
+            return ptr;
+        }
+    } else if (size <= old_size) {
+        return ptr;
     }
+
+    // Moving: take half as much again, so a buffer grown in small steps is
+    // copied O(log n) times rather than once per step
+    size_t roomy = old_size + old_size / 2;
+    void* new_ptr = size < roomy ? heap_alloc(roomy) : NULL;
+    if (!new_ptr) new_ptr = heap_alloc(size);
+    if (!new_ptr) return NULL;
+    PROFILE_RECORD(size - old_size);
     
+    memcpy(new_ptr, ptr, old_size);
     free(ptr);
     return new_ptr;
 }
@@ -84,8 +458,37 @@ int64_t __moddi3(int64_t a, int64_t b) {
 }
 
 void free(void* ptr) {
-    (void)ptr; // Mark as unused to suppress warning
-    // In a real implementation, you'd add this block back to free list
+    if (!ptr) return;
+
+    malloc_chunk_t* c = mem_to_chunk(ptr);
+    if (!(c->size & CHUNK_INUSE)) return;   // Double free
+
+    if (c->size & CHUNK_SPAN) {
+        pmm_free_pages(c, chunk_size(c) / PMM_PAGE_SIZE);
+        return;
+    }
+
+    size_t size = chunk_size(c);
+    malloc_chunk_t* next = chunk_next(c);
+    if (!(next->size & CHUNK_INUSE)) {
+        bin_remove(next);
+        size += chunk_size(next);
+    }
+    if (!(c->size & CHUNK_PREV_INUSE)) {
+        malloc_chunk_t* prev = (malloc_chunk_t*)((char*)c - c->prev_size);
+        bin_remove(prev);
+        size += chunk_size(prev);
+        c = prev;
+    }
+
+    // A whole PMM segment goes back unless the heap would run dry
+    malloc_chunk_t* after = (malloc_chunk_t*)((char*)c + size);
+    if (c->prev_size == SEGMENT_FROM_PMM && chunk_size(after) == 0 &&
+        heap_free_bytes >= MALLOC_SEGMENT_SIZE) {
+        pmm_free_pages(c, (size + MALLOC_HEADER) / PMM_PAGE_SIZE);
+        return;
+    }
+    chunk_release(c, size);
 }
 
 // Process control functions
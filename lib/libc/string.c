@@ -3,6 +3,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// Machine word that may alias any object, for the bulk copy loops
+typedef size_t __attribute__((__may_alias__)) mem_word_t;
+#define MEM_WORD sizeof(mem_word_t)
+
 // Calculate the length of a string
 size_t strlen(const char *str) {
     const char *s = str;
@@ -68,10 +72,34 @@ void *memset(void *s, int c, size_t n) {
     return s;
 }
 
-// Copy n bytes from one memory location to another
+// Copy n bytes from one memory location to another. When source and
+// destination share their alignment, copy a word (four per iteration) at a
+// time once the destination is aligned.
 void *memcpy(void *dest, const void *src, size_t n) {
     unsigned char *d = dest;
     const unsigned char *s = src;
+
+    if ((((uintptr_t)d ^ (uintptr_t)s) & (MEM_WORD - 1)) == 0) {
+        while (n && ((uintptr_t)d & (MEM_WORD - 1))) {
+            *d++ = *s++;
+            n--;
+        }
+
+        mem_word_t *dw = (mem_word_t *)d;
+        const mem_word_t *sw = (const mem_word_t *)s;
+        for (; n >= 4 * MEM_WORD; n -= 4 * MEM_WORD) {
+            dw[0] = sw[0];
+            dw[1] = sw[1];
+            dw[2] = sw[2];
+            dw[3] = sw[3];
+            dw += 4;
+            sw += 4;
+        }
+        for (; n >= MEM_WORD; n -= MEM_WORD) *dw++ = *sw++;
+        d = (unsigned char *)dw;
+        s = (const unsigned char *)sw;
+    }
+
     while (n--) *d++ = *s++;
     return dest;
 }
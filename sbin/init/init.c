@@ -7,6 +7,7 @@
 #include <string.h>
 #include <login.h>
 #include <arch/i386/cpu.h>
+#include <arch/i386/idt.h>
 #include <time.h>
 #include <sys/fs.h>
 #include <sys/process.h>
@@ -23,6 +24,10 @@
 #define MEDIUM_DELAY 100000
 #define LONG_DELAY   150000
 
+#define KERNEL_LOAD_ADDR  0x00100000
+#define MEMORY_TOP        VMM_BASE_ADDRESS  // RAM is identity-mapped; keep it below the VMM window
+#define MEMORY_MAX_RANGES 32
+
 extern shell_command_t shell_commands[];
 extern size_t shell_commands_count;
 
@@ -35,6 +40,14 @@ static const struct multiboot_header multiboot_header __attribute__((used)) = {
 struct refcnt ss_refcnt;
 static struct srp ss_srp;
 
+extern uint32_t multiboot_info_ptr;  // Saved from EBX in boot.s
+extern char _kernel_end[];           // Provided by linker.ld
+
+typedef struct {
+    uint64_t base;
+    uint64_t end;
+} mem_range_t;
+
 void early_cpu_init(void);
 
 static void print_banner_and_hardware(void) {
@@ -65,15 +78,95 @@ static void setup_hdmi(void) {
     vga_puts("\n");
 }
 
+// Framebuffers write-combined, device registers uncached. The text
+// buffer lies in the identity map, which is remapped in place so no
+// write-back alias of it remains.
+static void setup_video_mappings(void) {
+    uint32_t flags = PAGE_WRITABLE | PAGE_GLOBAL | PAGE_NX;
+
+    if (paging_map_range_attr(VGA_TEXT_PHYS, VGA_TEXT_PHYS, VGA_TEXT_SIZE / PAGE_SIZE,
+                              flags, PAGING_ATTR_WC))
+        vga_puts("vga0: text buffer mapped write-combining\n");
+    if (!paging_map_range_attr(HDMI_BASE_ADDR, HDMI_BASE_ADDR, 1, flags, PAGING_ATTR_UC))
+        vga_puts("hdmi0: could not map registers\n");
+}
+
 static void print_device_and_memory_info(void) {
     vga_puts(
-        "Paging: enabled\n"
         "Probing devices:\n"
         "kbd0: at atkbdc0 (kbd port)\n"
         "sc0: <System console> on isa0\n\n"
     );
 }
 
+// Split one usable range at the zone limits and register each piece
+static size_t add_memory_range(uint64_t base, uint64_t end) {
+    // Low memory holds the BIOS area and boot heap; the kernel image follows it
+    uint64_t floor = pmm_page_align_up((uintptr_t)_kernel_end);
+    size_t added = 0;
+
+    // Only whole pages; zone limits are page aligned, so every piece is too
+    base = (base + PMM_PAGE_SIZE - 1) & ~(uint64_t)(PMM_PAGE_SIZE - 1);
+    end &= ~(uint64_t)(PMM_PAGE_SIZE - 1);
+    if (base < floor) base = floor;
+    if (end > MEMORY_TOP) end = MEMORY_TOP;
+
+    while (base < end) {
+        pmm_zone_t zone = pmm_zone_for_addr((uintptr_t)base);
+        uint64_t limit = zone == PMM_ZONE_DMA    ? PMM_DMA_LIMIT
+                       : zone == PMM_ZONE_NORMAL ? PMM_NORMAL_LIMIT
+                       : MEMORY_TOP;
+        uint64_t piece_end = end < limit ? end : limit;
+
+        if (pmm_add_region((uintptr_t)base, (size_t)(piece_end - base), zone) == 0)
+            added += (size_t)(piece_end - base);
+        base = piece_end;
+    }
+    return added;
+}
+
+// Register every usable range from the multiboot memory map with the PMM.
+// Ranges are copied out first because region metadata is carved in place
+// and may overlap loader data.
+static void setup_physical_memory(void) {
+    const struct multiboot_info *mbi =
+        (const struct multiboot_info *)(uintptr_t)multiboot_info_ptr;
+    mem_range_t ranges[MEMORY_MAX_RANGES];
+    size_t nranges = 0;
+
+    if (mbi && (mbi->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        uintptr_t entry = mbi->mmap_addr;
+        uintptr_t mmap_end = mbi->mmap_addr + mbi->mmap_length;
+
+        while (entry < mmap_end && nranges < MEMORY_MAX_RANGES) {
+            const struct multiboot_mmap_entry *mm =
+                (const struct multiboot_mmap_entry *)entry;
+            if (mm->type == MULTIBOOT_MEMORY_AVAILABLE && mm->len > 0) {
+                ranges[nranges].base = mm->addr;
+                ranges[nranges].end = mm->addr + mm->len;
+                nranges++;
+            }
+            entry += mm->size + sizeof(mm->size);
+        }
+    } else if (mbi && (mbi->flags & MULTIBOOT_INFO_MEMORY)) {
+        ranges[0].base = KERNEL_LOAD_ADDR;
+        ranges[0].end = KERNEL_LOAD_ADDR + (uint64_t)mbi->mem_upper * 1024;
+        nranges = 1;
+    } else {
+        ranges[0].base = KERNEL_LOAD_ADDR;
+        ranges[0].end = 0x08000000;
+        nranges = 1;
+    }
+
+    pmm_init();
+    size_t usable = 0;
+    for (size_t i = 0; i < nranges; i++)
+        usable += add_memory_range(ranges[i].base, ranges[i].end);
+
+    vga_printf("pmm: %d MB usable in %d ranges\n",
+               (int)(usable / (1024 * 1024)), (int)nranges);
+}
+
 static void print_root_fs_readme(void) {
     const char *text =
         "Welcome to Unics!\n"
@@ -94,9 +187,6 @@ int main(void) {
     setup_hdmi();
     delay(MEDIUM_DELAY);
 
-    paging_init();
-    delay(SHORT_DELAY);
-
     print_device_and_memory_info();
     delay(SHORT_DELAY);
 
@@ -115,16 +205,28 @@ int main(void) {
 
     refcnt_init(&ss_refcnt);
     srp_init(&ss_srp);
-    vmm_init();
-    vga_puts("vmm: virtual memory manager online\n");
-    delay(SHORT_DELAY);
 
-    pmm_init();
-    pmm_add_region(0x00100000, 0x07F00000, PMM_ZONE_NORMAL);
-    pmm_reserve_range(0x00000000, 0x00100000);
+    setup_physical_memory();
     vga_puts("pmm: physical memory manager online\n");
     delay(SHORT_DELAY);
 
+    // Page tables and the identity map of RAM come from the PMM
+    paging_init();
+    if (paging_get_mode() != PAGING_OFF) {
+        vga_printf("paging: %s, %d MB identity-mapped, %d large pages, %d table pages\n",
+                   paging_get_mode() == PAGING_PAE ? "PAE" : "32-bit",
+                   (int)(pmm_highest_address() / (1024 * 1024)),
+                   (int)paging_large_pages(),
+                   (int)pmm_owner_pages(PAGING_OWNER_TAG));
+        setup_video_mappings();
+    }
+    delay(SHORT_DELAY);
+
+    // Extent descriptors come from the PMM
+    vmm_init();
+    vga_puts("vmm: virtual memory manager online\n");
+    delay(SHORT_DELAY);
+
     null_init();
     vga_puts("null: /dev/null ready\n");
     delay(SHORT_DELAY);
@@ -194,18 +296,16 @@ void early_cpu_init(void) {
     vga_puts("cpu0: FPU initialized\n");
     delay(SHORT_DELAY);
 
+    idt_init();
+    vga_puts("cpu0: IDT loaded, page faults handled by vmm\n");
+    delay(SHORT_DELAY);
+
     if (features.sse) {
         cpu_init_sse();
         vga_puts("cpu0: SSE enabled\n");
         delay(SHORT_DELAY);
     }
 
-    if (features.pae) {
-        cpu_set_cr4(cpu_get_cr4() | CR4_PAE);
-        vga_puts("cpu0: PAE enabled\n");
-        delay(SHORT_DELAY);
-    }
-
     if (features.sse || features.sse2) {
         cpu_enable_sse();
     }
@@ -0,0 +1,83 @@
+#include <arena.h>
+#include <pmm.h>
+#include <stdio.h>
+
+static char* chunk_end(arena_chunk_t *chunk) {
+    return (char*)chunk + chunk->pages * PMM_PAGE_SIZE;
+}
+
+static arena_chunk_t* chunk_alloc(size_t bytes) {
+    size_t pages = (bytes + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    if (pages < ARENA_CHUNK_PAGES) pages = ARENA_CHUNK_PAGES;
+
+    arena_chunk_t *chunk = pmm_alloc_pages(pages);
+    if (!chunk) return NULL;
+    pmm_page_set_owner(chunk, pages, ARENA_OWNER_TAG);
+    chunk->pages = pages;
+    chunk->next = NULL;
+    return chunk;
+}
+
+// The arena header lives in its first chunk, so creation is one PMM call
+arena_t* arena_create(void) {
+    arena_chunk_t *chunk = chunk_alloc(sizeof(arena_chunk_t) + sizeof(arena_t));
+    if (!chunk) {
+        printf("[arena] ERROR: Out of memory\n");
+        return NULL;
+    }
+
+    arena_t *arena = (arena_t*)(chunk + 1);
+    arena->chunks = chunk;
+    arena->ptr = (char*)(arena + 1);
+    arena->limit = chunk_end(chunk);
+    arena->pages = chunk->pages;
+    return arena;
+}
+
+void arena_destroy(arena_t *arena) {
+    if (!arena) return;
+
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        pmm_free_pages(chunk, chunk->pages);
+        chunk = next;
+    }
+}
+
+void* arena_alloc(arena_t *arena, size_t size) {
+    if (!arena || size > SIZE_MAX - PMM_PAGE_SIZE - sizeof(arena_chunk_t)) return NULL;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (size > (size_t)(arena->limit - arena->ptr)) {
+        // The rest of the current chunk is abandoned until the next reset
+        arena_chunk_t *chunk = chunk_alloc(sizeof(arena_chunk_t) + size);
+        if (!chunk) return NULL;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->ptr = (char*)(chunk + 1);
+        arena->limit = chunk_end(chunk);
+        arena->pages += chunk->pages;
+    }
+
+    void *p = arena->ptr;
+    arena->ptr += size;
+    return p;
+}
+
+arena_mark_t arena_mark(const arena_t *arena) {
+    arena_mark_t mark = { arena->chunks, arena->ptr };
+    return mark;
+}
+
+// Free every chunk added since the mark and rewind to it
+void arena_reset(arena_t *arena, arena_mark_t mark) {
+    while (arena->chunks != mark.chunk) {
+        arena_chunk_t *chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        arena->pages -= chunk->pages;
+        pmm_free_pages(chunk, chunk->pages);
+    }
+    arena->ptr = mark.ptr;
+    arena->limit = chunk_end(mark.chunk);
+}
@@ -0,0 +1,233 @@
+#include <kmem.h>
+#include <pmm.h>
+#include <string.h>
+#include <stdio.h>
+
+#define KMEM_MIN_ALIGN  8
+#define SLAB_LINK_END   0xFFFF
+
+// A slab is a naturally aligned run of pages: this header, one 16-bit free
+// list link per object, then the objects. Keeping the links outside the
+// objects leaves constructed state intact across free, and an object finds
+// its slab by masking its address, so objects carry no header at all.
+typedef struct kmem_slab {
+    struct kmem_slab *next;
+    struct kmem_slab *prev;
+    kmem_cache_t *cache;
+    char *objs;             // First object, after the color offset
+    uint16_t free;          // First free object, SLAB_LINK_END when full
+    uint16_t inuse;
+    uint16_t links[];
+} kmem_slab_t;
+
+struct kmem_cache {
+    char name[KMEM_NAME_MAX];
+    size_t size;            // Object stride
+    size_t slab_bytes;
+    size_t per_slab;
+    size_t objs_offset;     // Uncolored offset of the first object
+    size_t color_step;
+    size_t color_max;       // Slack left over in each slab
+    size_t color_next;
+    kmem_ctor_t ctor;
+    kmem_slab_t *partial;   // Slabs with free and used objects
+    kmem_slab_t *full;
+    kmem_slab_t *empty;     // At most one, kept to absorb alloc/free churn
+    kmem_cache_stats_t stats;
+    bool in_use;
+};
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+
+static void slab_list_insert(kmem_slab_t **list, kmem_slab_t *s) {
+    s->prev = NULL;
+    s->next = *list;
+    if (*list) (*list)->prev = s;
+    *list = s;
+}
+
+static void slab_list_remove(kmem_slab_t **list, kmem_slab_t *s) {
+    if (s->prev) s->prev->next = s->next;
+    else *list = s->next;
+    if (s->next) s->next->prev = s->prev;
+}
+
+// Pick the smallest slab whose leftover space is at most 1/8 of it
+static bool cache_layout(kmem_cache_t *cache, size_t align) {
+    for (size_t pages = 1; pages <= KMEM_MAX_SLAB_PAGES; pages <<= 1) {
+        size_t bytes = pages * PMM_PAGE_SIZE;
+        size_t n = (bytes - sizeof(kmem_slab_t)) / (cache->size + sizeof(uint16_t));
+        if (n > KMEM_MAX_OBJECTS - 1) n = KMEM_MAX_OBJECTS - 1;
+
+        size_t offset = 0;
+        while (n > 0) {
+            offset = sizeof(kmem_slab_t) + n * sizeof(uint16_t);
+            offset = (offset + align - 1) & ~(align - 1);
+            if (offset + n * cache->size <= bytes) break;
+            n--;
+        }
+        if (n == 0) continue;
+
+        size_t waste = bytes - offset - n * cache->size;
+        if (waste * 8 > bytes && pages < KMEM_MAX_SLAB_PAGES) continue;
+
+        cache->slab_bytes = bytes;
+        cache->per_slab = n;
+        cache->objs_offset = offset;
+        cache->color_max = waste - waste % cache->color_step;
+        return true;
+    }
+    return false;
+}
+
+static void slab_release(kmem_cache_t *cache, kmem_slab_t *s) {
+    pmm_free_pages(s, cache->slab_bytes / PMM_PAGE_SIZE);
+    cache->stats.slabs--;
+    cache->stats.reaps++;
+}
+
+static kmem_slab_t* slab_create(kmem_cache_t *cache) {
+    size_t pages = cache->slab_bytes / PMM_PAGE_SIZE;
+    kmem_slab_t *s = pages == 1 ? pmm_alloc_page()
+                                : pmm_alloc_constrained(pages, PMM_ZONE_NORMAL, cache->slab_bytes, 0);
+    if (!s) return NULL;
+    pmm_page_set_owner(s, pages, KMEM_OWNER_TAG);
+
+    // Stagger successive slabs across cache lines so the first objects of
+    // each do not all compete for the same sets
+    s->cache = cache;
+    s->objs = (char*)s + cache->objs_offset + cache->color_next;
+    cache->color_next += cache->color_step;
+    if (cache->color_next > cache->color_max) cache->color_next = 0;
+
+    s->free = 0;
+    s->inuse = 0;
+    for (size_t i = 0; i < cache->per_slab; i++) {
+        s->links[i] = i + 1 < cache->per_slab ? i + 1 : SLAB_LINK_END;
+        if (cache->ctor) cache->ctor(s->objs + i * cache->size);
+    }
+
+    cache->stats.slabs++;
+    cache->stats.grows++;
+    return s;
+}
+
+kmem_cache_t* kmem_cache_create(const char *name, size_t size, size_t align, kmem_ctor_t ctor) {
+    if (align == 0) align = KMEM_MIN_ALIGN;
+    if (size == 0 || (align & (align - 1)) || align > PMM_PAGE_SIZE) {
+        printf("[kmem] ERROR: Bad size %zu or alignment %zu for cache %s\n", size, align, name);
+        return NULL;
+    }
+
+    kmem_cache_t *cache = NULL;
+    for (size_t i = 0; i < KMEM_MAX_CACHES; i++) {
+        if (!caches[i].in_use) {
+            cache = &caches[i];
+            break;
+        }
+    }
+    if (!cache) {
+        printf("[kmem] ERROR: No free cache descriptor for %s\n", name);
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+    strncpy(cache->name, name, KMEM_NAME_MAX - 1);
+    cache->size = (size + align - 1) & ~(align - 1);
+    cache->color_step = align > KMEM_CACHE_LINE ? align : KMEM_CACHE_LINE;
+    cache->ctor = ctor;
+    if (!cache_layout(cache, align)) {
+        printf("[kmem] ERROR: Objects of %zu bytes do not fit a slab\n", size);
+        return NULL;
+    }
+
+    cache->stats.obj_size = cache->size;
+    cache->stats.objs_per_slab = cache->per_slab;
+    cache->stats.slab_pages = cache->slab_bytes / PMM_PAGE_SIZE;
+    cache->in_use = true;
+    return cache;
+}
+
+int kmem_cache_destroy(kmem_cache_t *cache) {
+    if (!cache || !cache->in_use) return -1;
+    if (cache->stats.active > 0) {
+        printf("[kmem] ERROR: Cache %s still has %zu objects\n", cache->name, cache->stats.active);
+        return -1;
+    }
+
+    if (cache->empty) slab_release(cache, cache->empty);
+    cache->in_use = false;
+    return 0;
+}
+
+void* kmem_cache_alloc(kmem_cache_t *cache) {
+    kmem_slab_t *s = cache->partial;
+    if (!s) {
+        s = cache->empty;
+        if (s) cache->empty = NULL;
+        else s = slab_create(cache);
+        if (!s) {
+            cache->stats.failures++;
+            return NULL;
+        }
+        slab_list_insert(&cache->partial, s);
+    }
+
+    uint16_t idx = s->free;
+    s->free = s->links[idx];
+    if (++s->inuse == cache->per_slab) {
+        slab_list_remove(&cache->partial, s);
+        slab_list_insert(&cache->full, s);
+    }
+
+    cache->stats.active++;
+    cache->stats.allocs++;
+    return s->objs + idx * cache->size;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    if (!obj) return;
+
+    kmem_slab_t *s = (kmem_slab_t*)((uintptr_t)obj & ~(cache->slab_bytes - 1));
+    size_t offset = (char*)obj - s->objs;
+    if (s->cache != cache || (char*)obj < s->objs || offset % cache->size ||
+        offset / cache->size >= cache->per_slab) {
+        printf("[kmem] ERROR: %p does not belong to cache %s\n", obj, cache->name);
+        return;
+    }
+
+    if (s->inuse == cache->per_slab) {
+        slab_list_remove(&cache->full, s);
+        slab_list_insert(&cache->partial, s);
+    }
+
+    uint16_t idx = offset / cache->size;
+    s->links[idx] = s->free;
+    s->free = idx;
+    cache->stats.active--;
+    cache->stats.frees++;
+
+    if (--s->inuse == 0) {
+        slab_list_remove(&cache->partial, s);
+        if (cache->empty) slab_release(cache, s);
+        else cache->empty = s;
+    }
+}
+
+int kmem_cache_get_stats(const kmem_cache_t *cache, kmem_cache_stats_t *stats) {
+    if (!cache || !cache->in_use || !stats) return -1;
+    *stats = cache->stats;
+    return 0;
+}
+
+void kmem_dump_stats(void) {
+    printf("[kmem] Cache Statistics:\n");
+    for (size_t i = 0; i < KMEM_MAX_CACHES; i++) {
+        kmem_cache_t *cache = &caches[i];
+        if (!cache->in_use) continue;
+        kmem_cache_stats_t *st = &cache->stats;
+        printf("  %-16s %4zu B x %3zu/slab: %zu active, %zu slabs (%zu grown, %zu reaped), %zu failed\n",
+               cache->name, st->obj_size, st->objs_per_slab, st->active, st->slabs,
+               st->grows, st->reaps, st->failures);
+    }
+}
@@ -1,46 +1,285 @@
 #include <paging.h>
 #include <pmm.h>
 #include <string.h>
+#include <arch/i386/cpu.h>
+#include <machine/pte.h>
+
+extern char _text_end[];    // End of .text/.rodata, provided by linker.ld
 
 static page_directory_t *kernel_page_directory = NULL;
 page_directory_t *current_page_directory = NULL;
 
-static inline size_t pd_index(uintptr_t addr) {
-    return (addr >> 22) & 0x3FF;
+// Color hint so page tables spread over the cache instead of stacking up
+static unsigned table_color;
+
+// Invalidations deferred by the range operations until their walk is done
+typedef struct {
+    uintptr_t addrs[PAGING_FLUSH_BATCH];
+    size_t count;
+    bool global;            // A PAGE_GLOBAL entry changed; CR3 reload won't do
+} flush_batch_t;
+
+static size_t flush_threshold = PAGING_FLUSH_THRESHOLD;
+static paging_tlb_stats_t tlb_stats;
+
+// Set by paging_init() from CPUID, applied to CR4 by paging_enable()
+static bool use_pse;
+static bool use_pge;
+static bool use_nx;
+static bool use_pat;
+static size_t large_pages;
+
+// PAT entries 0-3 as programmed by paging_enable(): WB, WC, UC-, UC. PWT
+// and PCD select among them, so an entry with neither stays write-back.
+#define PAT_VALUE       0x0007040600070106ULL   // WB WC UC- UC WB WT UC- UC
+
+static const uint32_t attr_bits[] = {
+    [PAGING_ATTR_WB] = 0,
+    [PAGING_ATTR_WC] = PAGE_WRITETHRU,
+    [PAGING_ATTR_UC] = PAGE_WRITETHRU | PAGE_NOCACHE,
+};
+
+// Table format, fixed at boot. Classic tables hold 1024 32-bit entries
+// and a directory entry maps 4 MB; PAE tables hold 512 64-bit entries, a
+// directory entry maps 2 MB and four directories hang off a PDPT.
+static bool pae;
+static size_t table_entries = PAGE_ENTRIES;
+static uintptr_t large_size = PAGE_LARGE_SIZE;
+static unsigned large_shift = 22;
+static uintptr_t pt_window = PAGING_PT_WINDOW;
+static paging_mode_t mode = PAGING_OFF;
+
+// Address spaces; slot 0 is the kernel's. The loaded one stays loaded
+// while kernel threads run.
+static vm_space_t spaces[VM_SPACE_MAX];
+static vm_space_t *active_space;
+static vm_space_stats_t space_stats;
+static uintptr_t user_base = PAGING_USER_END;   // End of the identity map
+
+#define ENTRY_NX        (1ULL << 63)
+#define PAE_ADDR_MASK   0x000FFFFFFFFFF000ULL
+#define PDPT_ENTRIES    4
+
+static inline uint64_t entry_get(void *table, size_t i) {
+    if (pae) return ((volatile uint64_t *)table)[i];
+    return ((uint32_t *)table)[i];
+}
+
+// A PAE entry takes two stores. Write the half holding the present bit
+// last when installing and first when clearing, so the walker never sees
+// a present entry with a stale address.
+static inline void entry_set(void *table, size_t i, uint64_t entry) {
+    if (!pae) {
+        ((uint32_t *)table)[i] = (uint32_t)entry;
+        return;
+    }
+    volatile uint32_t *half = (volatile uint32_t *)&((uint64_t *)table)[i];
+    if (entry & PAGE_PRESENT) {
+        half[1] = (uint32_t)(entry >> 32);
+        half[0] = (uint32_t)entry;
+    } else {
+        half[0] = (uint32_t)entry;
+        half[1] = (uint32_t)(entry >> 32);
+    }
+}
+
+static inline uint64_t entry_frame(uint64_t entry) {
+    return entry & (pae ? PAE_ADDR_MASK : 0xFFFFF000);
+}
+
+static inline uint64_t make_entry(uint64_t phys_addr, uint32_t flags) {
+    uint64_t entry = phys_addr | (flags & 0xFFF) | PAGE_PRESENT;
+    if ((flags & PAGE_NX) && use_nx) entry |= ENTRY_NX;
+    return entry;
 }
 
 static inline size_t pt_index(uintptr_t addr) {
-    return (addr >> 12) & 0x3FF;
+    return (addr >> 12) & (table_entries - 1);
+}
+
+// Once paging is on, the active space's tables are reached through the
+// recursive slot; during setup, and for other spaces, by physical address
+static inline bool tables_mapped(void *root) {
+    return mode != PAGING_OFF && root == (void *)current_page_directory;
+}
+
+// Directory holding the entry for addr, and that entry's index in it
+static void *dir_for(void *root, uintptr_t addr, size_t *index) {
+    if (!pae) {
+        *index = (addr >> 22) & 0x3FF;
+        return tables_mapped(root) ? (void *)PAGING_PD_WINDOW : root;
+    }
+    *index = (addr >> 21) & 0x1FF;
+    if (tables_mapped(root))
+        return (void *)(PAGING_PAE_PD_WINDOW + (addr >> 30) * PAGE_SIZE);
+    return (void *)(uintptr_t)entry_frame(((uint64_t *)root)[addr >> 30]);
+}
+
+// Page table named by the directory entry pde covering addr
+static inline void *table_for(void *root, uintptr_t addr, uint64_t pde) {
+    if (tables_mapped(root))
+        return (void *)(pt_window + (addr >> large_shift) * PAGE_SIZE);
+    return (void *)(uintptr_t)entry_frame(pde);
+}
+
+// First address of the self-map; nothing else may be mapped from there
+static inline uintptr_t window_base(void) {
+    return pt_window;
+}
+
+// Directory slots outside the user half are shared by every space
+static inline bool kernel_addr(uintptr_t addr) {
+    return addr < user_base || addr >= PAGING_USER_END;
+}
+
+// Install a directory entry. A change to the kernel half is copied into
+// every other space so they keep agreeing.
+static void set_dir_entry(void *root, uintptr_t addr, void *dir, size_t index, uint64_t entry) {
+    entry_set(dir, index, entry);
+    if (!kernel_addr(addr)) return;
+
+    for (size_t i = 0; i < VM_SPACE_MAX; i++) {
+        vm_space_t *space = &spaces[i];
+        if (!space->in_use || (void *)space->root == root) continue;
+
+        size_t other_index;
+        void *other = dir_for(space->root, addr, &other_index);
+        entry_set(other, other_index, entry);
+    }
+}
+
+static void *alloc_table(void) {
+    void *table = pmm_alloc_zeroed_page_color(&table_color);
+    if (table) pmm_page_set_owner(table, 1, PAGING_OWNER_TAG);
+    return table;
+}
+
+// Empty root table for the active format, self-mapped. Under PAE all
+// four directories are allocated up front: the CPU loads the PDPT entries
+// on every CR3 write, so they cannot be filled in lazily.
+static void *root_create(void) {
+    void *root = alloc_table();
+    if (!root) return NULL;
+    if (!pae) {
+        ((uint32_t *)root)[PAGE_ENTRIES - 1] = (uintptr_t)root | PAGE_PRESENT | PAGE_WRITABLE;
+        return root;
+    }
+
+    for (size_t i = 0; i < PDPT_ENTRIES; i++) {
+        void *pd = alloc_table();
+        if (!pd) {
+            while (i-- > 0)
+                pmm_free_page((void *)(uintptr_t)entry_frame(((uint64_t *)root)[i]));
+            pmm_free_page(root);
+            return NULL;
+        }
+        // PDPT entries take only P, PWT and PCD
+        ((uint64_t *)root)[i] = (uintptr_t)pd | PAGE_PRESENT;
+    }
+
+    uint64_t *pd3 = (uint64_t *)(uintptr_t)entry_frame(((uint64_t *)root)[PDPT_ENTRIES - 1]);
+    for (size_t i = 0; i < PDPT_ENTRIES; i++)
+        pd3[PAGE_ENTRIES_PAE - PDPT_ENTRIES + i] =
+            make_entry(entry_frame(((uint64_t *)root)[i]), PAGE_WRITABLE | PAGE_NX);
+    return root;
 }
 
-// Retrieve or allocate a page table for a virtual address
-static page_table_t *get_or_create_page_table(page_directory_t *pd, uintptr_t virt_addr, bool create) {
-    size_t pdi = pd_index(virt_addr);
-    page_entry_t entry = pd->entries[pdi];
+// Replace a large mapping by a page table mapping the same frames with the
+// same attributes, so a single page inside it can be changed. The table is
+// filled before it is installed, through its frame: the range being split
+// may hold the code doing the split.
+static void *split_large_page(void *root, void *dir, size_t index, uintptr_t virt_addr) {
+    uint64_t entry = entry_get(dir, index);
+    void *pt = pmm_alloc_page_color(PMM_ZONE_NORMAL, &table_color);
+    if (!pt) return NULL;
+    pmm_page_set_owner(pt, 1, PAGING_OWNER_TAG);
+
+    uint64_t flags = (entry & 0xFFF & ~PAGE_LARGE) | (entry & ENTRY_NX);
+    if (entry & PAGE_LARGE_PAT) flags |= PAGE_PAT;
+    uint64_t frame = entry_frame(entry) & ~(uint64_t)(large_size - 1);
+    for (size_t i = 0; i < table_entries; i++)
+        entry_set(pt, i, (frame + i * PAGE_SIZE) | flags);
+
+    set_dir_entry(root, virt_addr, dir, index,
+                  (uintptr_t)pt | (entry & (PAGE_USER | PAGE_WRITABLE)) | PAGE_PRESENT);
+    if (kernel_addr(virt_addr)) large_pages--;  // Only the kernel's are counted
+    paging_invalidate(virt_addr & ~(large_size - 1));
+
+    // The window page for this slot showed the first 4 KB of the large frame
+    void *table = table_for(root, virt_addr, entry_get(dir, index));
+    if (table != pt) paging_invalidate((uintptr_t)table);
+    return table;
+}
+
+// Retrieve or allocate a page table for a virtual address. A large mapping
+// is split on the first change to a page inside it.
+static void *get_or_create_page_table(void *root, uintptr_t virt_addr, bool create) {
+    size_t index;
+    void *dir = dir_for(root, virt_addr, &index);
+    uint64_t entry = entry_get(dir, index);
 
     if (entry & PAGE_PRESENT) {
-        return (page_table_t *)(entry & ~0xFFF);
+        if (entry & PAGE_LARGE)
+            return split_large_page(root, dir, index, virt_addr);
+        return table_for(root, virt_addr, entry);
     }
 
     if (!create) return NULL;
 
-    void *new_table = pmm_alloc_page();
+    void *new_table = alloc_table();
     if (!new_table) return NULL;
 
-    memset(new_table, 0, PAGE_SIZE);
-    pd->entries[pdi] = (uintptr_t)new_table | PAGE_PRESENT | PAGE_WRITABLE;
+    // The window page was not present, so nothing is cached for it
+    set_dir_entry(root, virt_addr, dir, index, (uintptr_t)new_table | PAGE_PRESENT | PAGE_WRITABLE);
 
-    return (page_table_t *)new_table;
+    return table_for(root, virt_addr, entry_get(dir, index));
 }
 
 void paging_init(void) {
-    kernel_page_directory = (page_directory_t *)pmm_alloc_page();
+    cpu_features_t features;
+    cpu_detect_features(&features);
+    pae = features.pae;
+    use_pse = features.pse || pae;  // PAE always has 2 MB pages
+    use_pge = features.pge;
+    use_nx = pae && features.nx;
+    use_pat = features.pat && features.msr;
+    if (pae) {
+        table_entries = PAGE_ENTRIES_PAE;
+        large_size = PAGE_LARGE_SIZE_PAE;
+        large_shift = 21;
+        pt_window = PAGING_PAE_PT_WINDOW;
+    }
+
+    kernel_page_directory = root_create();
     if (!kernel_page_directory) return;
 
-    memset(kernel_page_directory, 0, PAGE_SIZE);
     current_page_directory = kernel_page_directory;
+    spaces[0].root = kernel_page_directory;
+    spaces[0].in_use = true;
+    active_space = &spaces[0];
 
-    // Optional: identity map lower memory or map kernel to higher half
+    // Identity-map RAM, the kernel image and low memory included. Every
+    // whole large frame is one global directory entry and needs no table;
+    // only a ragged end, or a CPU without PSE, falls back to 4 KB pages.
+    // Past the kernel's text everything is data and, given NX, not
+    // executable.
+    uintptr_t top = pmm_highest_address();
+    if (top == 0) return;
+    user_base = (top + large_size - 1) & ~(large_size - 1);
+
+    uint32_t flags = PAGE_WRITABLE | (use_pge ? PAGE_GLOBAL : 0);
+    uintptr_t exec_end = ((uintptr_t)_text_end + large_size - 1) & ~(large_size - 1);
+    uintptr_t large_end = use_pse ? top & ~(large_size - 1) : 0;
+    for (uintptr_t addr = 0; addr < large_end; addr += large_size) {
+        size_t index;
+        void *dir = dir_for(kernel_page_directory, addr, &index);
+        uint32_t nx = addr >= exec_end ? PAGE_NX : 0;
+        entry_set(dir, index, make_entry(addr, flags | nx | PAGE_LARGE));
+        large_pages++;
+    }
+    if (large_end >= exec_end) flags |= PAGE_NX;
+    if (!paging_map_range(large_end, large_end, (top - large_end) / PAGE_SIZE, flags))
+        return;
 
     paging_enable();
 }
@@ -48,12 +287,12 @@ void paging_init(void) {
 bool paging_map_page(uintptr_t virt_addr, uintptr_t phys_addr, uint32_t flags) {
     if (!pmm_is_page_aligned(virt_addr) || !pmm_is_page_aligned(phys_addr))
         return false;
+    if (virt_addr >= window_base()) return false;
 
-    page_table_t *pt = get_or_create_page_table(current_page_directory, virt_addr, true);
+    void *pt = get_or_create_page_table(current_page_directory, virt_addr, true);
     if (!pt) return false;
 
-    size_t pti = pt_index(virt_addr);
-    pt->entries[pti] = phys_addr | (flags & 0xFFF) | PAGE_PRESENT;
+    entry_set(pt, pt_index(virt_addr), make_entry(phys_addr, flags));
 
     paging_invalidate(virt_addr);
     return true;
@@ -63,28 +302,183 @@ bool paging_unmap_page(uintptr_t virt_addr) {
     if (!pmm_is_page_aligned(virt_addr))
         return false;
 
-    page_table_t *pt = get_or_create_page_table(current_page_directory, virt_addr, false);
+    void *pt = get_or_create_page_table(current_page_directory, virt_addr, false);
     if (!pt) return false;
 
     size_t pti = pt_index(virt_addr);
-    if (!(pt->entries[pti] & PAGE_PRESENT))
+    if (!(entry_get(pt, pti) & PAGE_PRESENT))
         return false;
 
-    pt->entries[pti] = 0;
+    entry_set(pt, pti, 0);
     paging_invalidate(virt_addr);
 
     return true;
 }
 
+static void flush_batch_add(flush_batch_t *batch, uintptr_t virt_addr, uint64_t old) {
+    if (old & PAGE_GLOBAL) batch->global = true;
+    if (batch->count < flush_threshold)
+        batch->addrs[batch->count] = virt_addr;
+    batch->count++;
+}
+
+static void flush_all(bool global) {
+    uint32_t cr4 = 0;
+    if (global) asm volatile("mov %%cr4, %0" : "=r"(cr4));
+
+    if (cr4 & CR4_PGE) {
+        // Toggling PGE drops global entries too
+        asm volatile("mov %0, %%cr4" :: "r"(cr4 & ~CR4_PGE) : "memory");
+        asm volatile("mov %0, %%cr4" :: "r"(cr4) : "memory");
+    } else {
+        uint32_t cr3;
+        asm volatile("mov %%cr3, %0" : "=r"(cr3));
+        asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+    }
+}
+
+static void flush_batch_run(flush_batch_t *batch) {
+    if (batch->count == 0) return;
+
+    if (batch->count > flush_threshold) {
+        flush_all(batch->global);
+        tlb_stats.full_flushes++;
+        tlb_stats.flushes_avoided += batch->count - 1;
+    } else {
+        for (size_t i = 0; i < batch->count; i++)
+            paging_invalidate(batch->addrs[i]);
+        tlb_stats.invlpg += batch->count;
+    }
+    batch->count = 0;
+    batch->global = false;
+}
+
+// Map pages consecutive frames starting at phys_addr. Each page table is
+// looked up once; a failed table allocation undoes the partial mapping.
+bool paging_map_range(uintptr_t virt_addr, uintptr_t phys_addr, size_t pages, uint32_t flags) {
+    if (!pmm_is_page_aligned(virt_addr) || !pmm_is_page_aligned(phys_addr))
+        return false;
+    if (!current_page_directory) return false;
+    if (virt_addr >= window_base() || pages > (window_base() - virt_addr) / PAGE_SIZE)
+        return false;
+
+    flush_batch_t batch = { .count = 0, .global = false };
+    size_t done = 0;
+
+    while (done < pages) {
+        uintptr_t va = virt_addr + done * PAGE_SIZE;
+        void *pt = get_or_create_page_table(current_page_directory, va, true);
+        if (!pt) {
+            flush_batch_run(&batch);
+            paging_unmap_range(virt_addr, done);
+            return false;
+        }
+
+        size_t pti = pt_index(va);
+        size_t run = table_entries - pti;
+        if (run > pages - done) run = pages - done;
+
+        uintptr_t pa = phys_addr + done * PAGE_SIZE;
+        for (size_t i = 0; i < run; i++, pa += PAGE_SIZE) {
+            uint64_t old = entry_get(pt, pti + i);
+            entry_set(pt, pti + i, make_entry(pa, flags));
+
+            // Not-present entries are never cached, so only a remap needs
+            // an invalidation
+            if (old & PAGE_PRESENT)
+                flush_batch_add(&batch, va + i * PAGE_SIZE, old);
+            else
+                tlb_stats.flushes_avoided++;
+        }
+        done += run;
+    }
+
+    flush_batch_run(&batch);
+    return true;
+}
+
+// Clear the mappings in [virt_addr, virt_addr + pages pages), skipping
+// holes and absent page tables. Returns how many pages were mapped.
+size_t paging_unmap_range(uintptr_t virt_addr, size_t pages) {
+    if (!pmm_is_page_aligned(virt_addr) || !current_page_directory)
+        return 0;
+
+    flush_batch_t batch = { .count = 0, .global = false };
+    size_t unmapped = 0;
+    size_t done = 0;
+
+    while (done < pages) {
+        uintptr_t va = virt_addr + done * PAGE_SIZE;
+        size_t pti = pt_index(va);
+        size_t run = table_entries - pti;
+        if (run > pages - done) run = pages - done;
+
+        void *pt = get_or_create_page_table(current_page_directory, va, false);
+        if (pt) {
+            for (size_t i = 0; i < run; i++) {
+                uint64_t old = entry_get(pt, pti + i);
+                if (!(old & PAGE_PRESENT)) continue;
+                entry_set(pt, pti + i, 0);
+                flush_batch_add(&batch, va + i * PAGE_SIZE, old);
+                unmapped++;
+            }
+        }
+        done += run;
+    }
+
+    flush_batch_run(&batch);
+    return unmapped;
+}
+
+// Map a range with a given memory type. Without PAT there is no
+// write-combining, and WC falls back to uncached.
+bool paging_map_range_attr(uintptr_t virt_addr, uintptr_t phys_addr, size_t pages,
+                           uint32_t flags, paging_attr_t attr) {
+    if (attr > PAGING_ATTR_UC) return false;
+    if (attr == PAGING_ATTR_WC && !use_pat) attr = PAGING_ATTR_UC;
+
+    flags &= ~(uint32_t)(PAGE_WRITETHRU | PAGE_NOCACHE | PAGE_PAT);
+    if (!paging_map_range(virt_addr, phys_addr, pages, flags | attr_bits[attr]))
+        return false;
+
+    // Lines cached under the old type must not be written back later
+    if (attr != PAGING_ATTR_WB) cpu_wbinvd();
+    return true;
+}
+
+void paging_set_flush_threshold(size_t pages) {
+    flush_threshold = pages > PAGING_FLUSH_BATCH ? PAGING_FLUSH_BATCH : pages;
+}
+
+paging_tlb_stats_t paging_get_tlb_stats(void) {
+    return tlb_stats;
+}
+
+size_t paging_large_pages(void) {
+    return large_pages;
+}
+
+paging_mode_t paging_get_mode(void) {
+    return mode;
+}
+
 uintptr_t paging_get_physical(uintptr_t virt_addr) {
-    page_table_t *pt = get_or_create_page_table(current_page_directory, virt_addr, false);
-    if (!pt) return 0;
+    if (!current_page_directory) return 0;
 
-    size_t pti = pt_index(virt_addr);
-    page_entry_t entry = pt->entries[pti];
+    size_t index;
+    void *dir = dir_for(current_page_directory, virt_addr, &index);
+    uint64_t pde = entry_get(dir, index);
+    if (!(pde & PAGE_PRESENT)) return 0;
+
+    if (pde & PAGE_LARGE)
+        return (uintptr_t)(entry_frame(pde) & ~(uint64_t)(large_size - 1)) |
+               (virt_addr & (large_size - 1) & ~(uintptr_t)0xFFF);
+
+    void *pt = table_for(current_page_directory, virt_addr, pde);
+    uint64_t entry = entry_get(pt, pt_index(virt_addr));
     if (!(entry & PAGE_PRESENT)) return 0;
 
-    return entry & ~0xFFF;
+    return (uintptr_t)entry_frame(entry);
 }
 
 void paging_invalidate(uintptr_t virt_addr) {
@@ -94,9 +488,266 @@ void paging_invalidate(uintptr_t virt_addr) {
 void paging_enable(void) {
     uintptr_t pd_phys = (uintptr_t)current_page_directory;
 
+    // CR4.PAE selects the table format built by paging_init(); under the
+    // classic format PSE makes bit 7 of a directory entry select 4 MB
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 &= ~(CR4_PAE | CR4_PSE);
+    if (pae) cr4 |= CR4_PAE;
+    if (use_pse) cr4 |= CR4_PSE;
+    asm volatile("mov %0, %%cr4" :: "r"(cr4));
+
+    if (use_nx) cpu_enable_nx();
+    if (use_pat) cpu_write_msr(MSR_PAT, PAT_VALUE);
+
     asm volatile("mov %0, %%cr3" :: "r"(pd_phys));
+    // WP makes ring 0 honour read-only entries too, so kernel writes to
+    // copy-on-write pages fault like user writes
     uint32_t cr0;
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
-    cr0 |= 0x80000000;
+    cr0 |= 0x80000000 | 0x10000;
     asm volatile("mov %0, %%cr0" :: "r"(cr0));
+
+    // Global entries survive CR3 reloads from here on
+    if (use_pge) {
+        cr4 |= CR4_PGE;
+        asm volatile("mov %0, %%cr4" :: "r"(cr4));
+    }
+    mode = pae ? PAGING_PAE : PAGING_32BIT;
+}
+
+// Number of directory slots and the address each one starts at
+static inline size_t dir_slots(void) {
+    return pae ? PDPT_ENTRIES * PAGE_ENTRIES_PAE : PAGE_ENTRIES;
+}
+
+static inline uintptr_t slot_addr(size_t slot) {
+    return (uintptr_t)slot << large_shift;
+}
+
+// Frames the PMM hands out carry references; device memory and reserved
+// frames mapped into a space do not
+static bool frame_counted(uint64_t frame) {
+    vm_page_t *page = pmm_page_lookup((void *)(uintptr_t)frame);
+    return page && page->refcount > 0 && !(page->flags & VM_PAGE_RESERVED);
+}
+
+// Drop one reference on every counted frame a large entry maps
+static void large_frames_put(uint64_t pde) {
+    uint64_t base = entry_frame(pde) & ~(uint64_t)(large_size - 1);
+    for (uint64_t frame = base; frame < base + large_size; frame += PAGE_SIZE) {
+        if (frame_counted(frame)) pmm_page_put((void *)(uintptr_t)frame);
+    }
+}
+
+// Drop the user half of a space that is not loaded: one frame reference
+// per mapping, then the page tables themselves
+static void release_user_half(void *root) {
+    for (size_t slot = 0; slot < dir_slots(); slot++) {
+        uintptr_t addr = slot_addr(slot);
+        if (kernel_addr(addr)) continue;
+
+        size_t index;
+        void *dir = dir_for(root, addr, &index);
+        uint64_t pde = entry_get(dir, index);
+        if (!(pde & PAGE_PRESENT)) continue;
+
+        if (pde & PAGE_LARGE) {
+            large_frames_put(pde);
+        } else {
+            void *pt = (void *)(uintptr_t)entry_frame(pde);
+            for (size_t i = 0; i < table_entries; i++) {
+                uint64_t pte = entry_get(pt, i);
+                if ((pte & PAGE_PRESENT) && frame_counted(entry_frame(pte)))
+                    pmm_page_put((void *)(uintptr_t)entry_frame(pte));
+            }
+            pmm_free_page(pt);
+        }
+        entry_set(dir, index, 0);
+    }
+}
+
+// New space: an empty user half and the kernel half copied from the
+// kernel's directory. NULL before paging is on or when out of memory.
+vm_space_t *vm_space_create(void) {
+    if (mode == PAGING_OFF) return NULL;
+
+    vm_space_t *space = NULL;
+    for (size_t i = 1; i < VM_SPACE_MAX && !space; i++) {
+        if (!spaces[i].in_use) space = &spaces[i];
+    }
+    if (!space) return NULL;
+
+    void *root = root_create();
+    if (!root) return NULL;
+
+    for (size_t slot = 0; slot < dir_slots(); slot++) {
+        uintptr_t addr = slot_addr(slot);
+        if (!kernel_addr(addr) || addr >= window_base()) continue;
+
+        size_t from, to;
+        void *src = dir_for(kernel_page_directory, addr, &from);
+        void *dst = dir_for(root, addr, &to);
+        entry_set(dst, to, entry_get(src, from));
+    }
+
+    space->root = root;
+    space->in_use = true;
+    return space;
+}
+
+// New space sharing every user page of parent. Writable pages become
+// read-only copy-on-write in both; each shared frame gains a reference,
+// so the last space to write it can take it back without a copy. Large
+// pages in the parent are split into page tables first. Frames outside
+// the page database (device memory) are shared as they are.
+vm_space_t *vm_space_clone(vm_space_t *parent) {
+    if (!parent || !parent->in_use) return NULL;
+
+    vm_space_t *child = vm_space_create();
+    if (!child) return NULL;
+
+    flush_batch_t batch = { .count = 0, .global = false };
+    bool loaded = parent == active_space;
+
+    for (size_t slot = 0; slot < dir_slots(); slot++) {
+        uintptr_t addr = slot_addr(slot);
+        if (kernel_addr(addr)) continue;
+
+        size_t index, child_index;
+        void *dir = dir_for(parent->root, addr, &index);
+        void *child_dir = dir_for(child->root, addr, &child_index);
+        uint64_t pde = entry_get(dir, index);
+        if (!(pde & PAGE_PRESENT)) continue;
+
+        // A large page cannot be copied on write; split it so its frames
+        // go through the per-page path like any other
+        void *pt;
+        if (pde & PAGE_LARGE) {
+            pt = split_large_page(parent->root, dir, index, addr);
+            if (!pt) {
+                flush_batch_run(&batch);
+                vm_space_destroy(child);
+                return NULL;
+            }
+            pde = entry_get(dir, index);
+        } else {
+            pt = table_for(parent->root, addr, pde);
+        }
+
+        void *child_pt = alloc_table();
+        if (!child_pt) {
+            flush_batch_run(&batch);
+            vm_space_destroy(child);
+            return NULL;
+        }
+
+        for (size_t i = 0; i < table_entries; i++) {
+            uint64_t pte = entry_get(pt, i);
+            if (!(pte & PAGE_PRESENT)) continue;
+
+            if (frame_counted(entry_frame(pte)) &&
+                pmm_page_get((void *)(uintptr_t)entry_frame(pte)) >= 0 &&
+                (pte & PAGE_WRITABLE)) {
+                uint64_t old = pte;
+                pte = (pte & ~(uint64_t)PAGE_WRITABLE) | PAGE_COW;
+                entry_set(pt, i, pte);
+                if (loaded) flush_batch_add(&batch, addr + i * PAGE_SIZE, old);
+            }
+            entry_set(child_pt, i, pte);
+        }
+        entry_set(child_dir, child_index,
+                  (uintptr_t)child_pt | (pde & (PAGE_USER | PAGE_WRITABLE)) | PAGE_PRESENT);
+    }
+
+    flush_batch_run(&batch);
+    return child;
+}
+
+// Resolve a write fault on a copy-on-write page of the loaded space. A
+// frame no other space maps any more is made writable again in place;
+// otherwise the page is copied. Returns false if the fault is not one.
+bool vm_space_handle_cow(uintptr_t addr, uint32_t error) {
+    if (!(error & PGEX_P) || !(error & PGEX_W)) return false;
+    if (mode == PAGING_OFF || kernel_addr(addr)) return false;
+
+    uintptr_t va = addr & ~(uintptr_t)(PAGE_SIZE - 1);
+    size_t index;
+    void *dir = dir_for(current_page_directory, va, &index);
+    uint64_t pde = entry_get(dir, index);
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) return false;
+
+    void *pt = table_for(current_page_directory, va, pde);
+    size_t pti = pt_index(va);
+    uint64_t pte = entry_get(pt, pti);
+    if (!(pte & PAGE_PRESENT) || !(pte & PAGE_COW)) return false;
+
+    void *frame = (void *)(uintptr_t)entry_frame(pte);
+    uint64_t flags = ((pte ^ entry_frame(pte)) & ~(uint64_t)PAGE_COW) | PAGE_WRITABLE;
+    vm_page_t *page = pmm_page_lookup(frame);
+
+    if (page && page->refcount == 1) {
+        entry_set(pt, pti, (uint64_t)(uintptr_t)frame | flags);
+        space_stats.cow_reuses++;
+    } else {
+        void *copy = pmm_alloc_page();
+        if (!copy) return false;
+        memcpy(copy, (void *)va, PAGE_SIZE);
+        entry_set(pt, pti, (uint64_t)(uintptr_t)copy | flags);
+        pmm_page_put(frame);
+        space_stats.cow_copies++;
+    }
+    paging_invalidate(va);
+    return true;
+}
+
+// Free a space, its user page tables and its references to the frames
+// mapped there. A space still loaded for a kernel thread is unloaded
+// first. The kernel space cannot be destroyed.
+int vm_space_destroy(vm_space_t *space) {
+    if (!space || space == &spaces[0] || !space->in_use) return -1;
+
+    if (space == active_space)
+        vm_space_switch(&spaces[0]);
+
+    void *root = space->root;
+    release_user_half(root);
+    if (pae) {
+        for (size_t i = 0; i < PDPT_ENTRIES; i++)
+            pmm_free_page((void *)(uintptr_t)entry_frame(((uint64_t *)root)[i]));
+    }
+    pmm_free_page(root);
+
+    space->root = NULL;
+    space->in_use = false;
+    return 0;
+}
+
+// Load a space. A kernel thread (NULL) touches only the kernel half,
+// which every space maps alike, so it runs on whatever is loaded; so does
+// a switch to the space already loaded. Neither reloads CR3, and the TLB
+// survives.
+void vm_space_switch(vm_space_t *space) {
+    space_stats.switches++;
+    if (!space || space == active_space || mode == PAGING_OFF) {
+        space_stats.lazy++;
+        return;
+    }
+
+    active_space = space;
+    current_page_directory = space->root;
+    asm volatile("mov %0, %%cr3" :: "r"((uintptr_t)space->root) : "memory");
+    space_stats.cr3_loads++;
+}
+
+vm_space_t *vm_space_current(void) {
+    return active_space;
+}
+
+vm_space_t *vm_space_kernel(void) {
+    return &spaces[0];
+}
+
+vm_space_stats_t vm_space_get_stats(void) {
+    return space_stats;
 }
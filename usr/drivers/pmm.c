@@ -1,23 +1,69 @@
 #include <pmm.h>
 #include <string.h>
 #include <stdio.h>
-#include <stdlib.h>
+#include <arch/i386/cpu.h>
 
 // Global state
 static pmm_region_t *pmm_regions = NULL;
 static bool pmm_initialized = false;
 
-// Built-in CLZ for systems without hardware support
-static inline int clz64(uint64_t x) {
-    if (x == 0) return 64;
-    int n = 0;
-    if (x <= 0x00000000FFFFFFFFULL) { n += 32; x <<= 32; }
-    if (x <= 0x0000FFFFFFFFFFFFULL) { n += 16; x <<= 16; }
-    if (x <= 0x00FFFFFFFFFFFFFFULL) { n += 8;  x <<= 8;  }
-    if (x <= 0x0FFFFFFFFFFFFFFFULL) { n += 4;  x <<= 4;  }
-    if (x <= 0x3FFFFFFFFFFFFFFFULL) { n += 2;  x <<= 2;  }
-    if (x <= 0x7FFFFFFFFFFFFFFFULL) { n += 1; }
-    return n;
+// Running totals so statistics never walk the bitmaps
+static size_t zone_pages[PMM_ZONE_COUNT];
+static size_t zone_free[PMM_ZONE_COUNT];
+
+// Per-CPU magazines: small LIFO stacks of recently freed frames per zone.
+// Cached frames stay marked allocated in the bitmap and are counted back
+// as free in the statistics.
+typedef struct {
+    size_t count;
+    uintptr_t frames[PMM_MAGAZINE_SIZE];
+} pmm_magazine_t;
+
+static pmm_magazine_t magazines[PMM_MAX_CPUS][PMM_ZONE_COUNT];
+static pmm_cpu_stats_t cpu_stats[PMM_MAX_CPUS];
+static size_t zone_cached[PMM_ZONE_COUNT];
+
+// Sparse section table: one slot per 1 MB of the 32-bit physical space,
+// pointing at the region that covers it. Sections shared by more than one
+// region (rare: only where two regions meet inside the same megabyte) fall
+// back to walking the region list.
+#define PMM_SECTION_SHIFT 20
+#define PMM_SECTION_COUNT ((size_t)1 << (32 - PMM_SECTION_SHIFT))
+#define PMM_SECTION_SHARED ((pmm_region_t *)1)
+
+static pmm_region_t *pmm_sections[PMM_SECTION_COUNT];
+
+// Pool of frames cleared ahead of time by the idle loop. Like magazine
+// frames they stay marked allocated, but are counted per zone apart from
+// zone_cached: pmm_drain_magazines() does not return them.
+static struct {
+    size_t count;
+    uintptr_t frames[PMM_ZERO_POOL_SIZE];
+} zero_pool;
+static size_t zone_pooled[PMM_ZONE_COUNT];
+
+static pmm_zero_stats_t zero_stats;
+static bool zero_use_movnti = false;
+
+// Page coloring: frames whose numbers agree modulo color_count map to the
+// same L2 sets
+static unsigned color_count = 1;
+static size_t color_hits;
+static size_t color_misses;
+
+// Only the boot processor runs kernel code for now
+static inline unsigned pmm_this_cpu(void) {
+    return 0;
+}
+
+#define BUDDY_NONE UINT32_MAX
+
+// Count trailing zeros on the two 32-bit halves (avoids a libgcc call)
+static inline int ctz64(uint64_t x) {
+    uint32_t lo = (uint32_t)x;
+    if (lo) return __builtin_ctz(lo);
+    uint32_t hi = (uint32_t)(x >> 32);
+    return hi ? 32 + __builtin_ctz(hi) : 64;
 }
 
 // Fast bit manipulation using 64-bit words
@@ -35,20 +81,400 @@ static inline bool test_bit_64(const uint64_t *bitmap, size_t bit) {
 
 // Find first zero bit in a 64-bit word (returns 64 if all bits set)
 static inline int find_first_zero_bit_64(uint64_t word) {
-    return clz64(~word);
+    return ctz64(~word);
+}
+
+// Page state changes keep the summary bitmap and free counters in step
+static inline void region_mark_used(pmm_region_t *region, size_t idx) {
+    size_t word = idx / 64;
+    region->bitmap[word] |= 1ULL << (idx % 64);
+    if (region->bitmap[word] == ~0ULL) {
+        clear_bit_64(region->summary, word);
+    }
+    region->free_pages--;
+    zone_free[region->zone]--;
+}
+
+static inline int popcount64(uint64_t x) {
+    return __builtin_popcount((uint32_t)x) + __builtin_popcount((uint32_t)(x >> 32));
+}
+
+// Mask of bits [lo, hi) within one bitmap word, 0 <= lo < hi <= 64
+static inline uint64_t word_mask(size_t lo, size_t hi) {
+    uint64_t mask = ~0ULL << lo;
+    return hi < 64 ? mask & ~(~0ULL << hi) : mask;
+}
+
+// Whole-word range updates: each bitmap word is touched once and the
+// counters move by the number of bits that actually changed
+static void region_mark_used_range(pmm_region_t *region, size_t start, size_t count) {
+    size_t end = start + count;
+    size_t changed = 0;
+
+    while (start < end) {
+        size_t word = start / 64;
+        size_t hi = (end - word * 64) < 64 ? end - word * 64 : 64;
+        uint64_t mask = word_mask(start % 64, hi);
+
+        changed += popcount64(~region->bitmap[word] & mask);
+        region->bitmap[word] |= mask;
+        if (region->bitmap[word] == ~0ULL) {
+            clear_bit_64(region->summary, word);
+        }
+        start = (word + 1) * 64;
+    }
+    region->free_pages -= changed;
+    zone_free[region->zone] -= changed;
+}
+
+static void region_mark_free_range(pmm_region_t *region, size_t start, size_t count) {
+    size_t end = start + count;
+    size_t changed = 0;
+
+    while (start < end) {
+        size_t word = start / 64;
+        size_t hi = (end - word * 64) < 64 ? end - word * 64 : 64;
+        uint64_t mask = word_mask(start % 64, hi);
+
+        changed += popcount64(region->bitmap[word] & mask);
+        region->bitmap[word] &= ~mask;
+        set_bit_64(region->summary, word);
+        start = (word + 1) * 64;
+    }
+    region->free_pages += changed;
+    zone_free[region->zone] += changed;
+}
+
+// True when every page in [start, start + count) is marked allocated
+static bool region_range_allocated(const pmm_region_t *region, size_t start, size_t count) {
+    size_t end = start + count;
+
+    while (start < end) {
+        size_t word = start / 64;
+        size_t hi = (end - word * 64) < 64 ? end - word * 64 : 64;
+        uint64_t mask = word_mask(start % 64, hi);
+
+        if ((region->bitmap[word] & mask) != mask) return false;
+        start = (word + 1) * 64;
+    }
+    return true;
+}
+
+// First free page in [start, end), or end if there is none
+static size_t find_next_free_page(const pmm_region_t *region, size_t start, size_t end) {
+    while (start < end) {
+        size_t word = start / 64;
+        uint64_t free_bits = ~region->bitmap[word] & (~0ULL << (start % 64));
+        if (free_bits) {
+            size_t idx = word * 64 + ctz64(free_bits);
+            return idx < end ? idx : end;
+        }
+        start = (word + 1) * 64;
+    }
+    return end;
+}
+
+// First bitmap word at or after start_word that still has a free page
+static size_t find_free_word(const pmm_region_t *region, size_t start_word) {
+    size_t s = start_word / 64;
+    if (s >= region->summary_size) return region->bitmap_size;
+
+    uint64_t word = region->summary[s] & (~0ULL << (start_word % 64));
+    while (!word) {
+        if (++s >= region->summary_size) return region->bitmap_size;
+        word = region->summary[s];
+    }
+    return s * 64 + ctz64(word);
+}
+
+// Physical frame number of a page inside a region
+static inline size_t region_pfn(const pmm_region_t *region, size_t idx) {
+    return region->base / PMM_PAGE_SIZE + idx;
+}
+
+static inline unsigned frame_color(uintptr_t addr) {
+    return (addr / PMM_PAGE_SIZE) & (color_count - 1);
+}
+
+// Smallest order whose block holds count pages
+static inline unsigned order_for_count(size_t count) {
+    unsigned order = 0;
+    while (((size_t)1 << order) < count) order++;
+    return order;
+}
+
+// Buddy free list primitives. Blocks are naturally aligned on the physical
+// frame number, so an order-10 block is a 4 MB aligned run of frames. The
+// bitmap stays authoritative for allocated/free state; the free lists index
+// the free runs so contiguous requests never scan the bitmap.
+static void buddy_list_add(pmm_region_t *region, size_t idx, unsigned order) {
+    pmm_free_area_t *area = &region->free_area[order];
+
+    region->links[idx].prev = BUDDY_NONE;
+    region->links[idx].next = area->head;
+    if (area->head != BUDDY_NONE) {
+        region->links[area->head].prev = idx;
+    }
+    area->head = idx;
+    area->count++;
+    region->order_map[idx] = order + 1;
+}
+
+static void buddy_list_del(pmm_region_t *region, size_t idx, unsigned order) {
+    pmm_free_area_t *area = &region->free_area[order];
+    pmm_buddy_link_t *link = &region->links[idx];
+
+    if (link->prev != BUDDY_NONE) {
+        region->links[link->prev].next = link->next;
+    } else {
+        area->head = link->next;
+    }
+    if (link->next != BUDDY_NONE) {
+        region->links[link->next].prev = link->prev;
+    }
+    area->count--;
+    region->order_map[idx] = 0;
+}
+
+// Index of the buddy of the block at idx, or BUDDY_NONE if it lies outside the region
+static size_t buddy_index(const pmm_region_t *region, size_t idx, unsigned order) {
+    size_t base_pfn = region->base / PMM_PAGE_SIZE;
+    size_t buddy_pfn = (base_pfn + idx) ^ ((size_t)1 << order);
+
+    if (buddy_pfn < base_pfn) return BUDDY_NONE;
+    size_t buddy = buddy_pfn - base_pfn;
+    if (buddy + ((size_t)1 << order) > region->pages) return BUDDY_NONE;
+    return buddy;
+}
+
+// Insert a naturally aligned free block, coalescing with free buddies
+static void buddy_free_block(pmm_region_t *region, size_t idx, unsigned order) {
+    while (order < PMM_MAX_ORDER) {
+        size_t buddy = buddy_index(region, idx, order);
+        if (buddy == BUDDY_NONE || region->order_map[buddy] != order + 1) break;
+
+        buddy_list_del(region, buddy, order);
+        if (buddy < idx) idx = buddy;
+        order++;
+    }
+    buddy_list_add(region, idx, order);
+}
+
+// Release an arbitrary run of pages as a minimal set of aligned blocks
+static void buddy_free_range(pmm_region_t *region, size_t idx, size_t count) {
+    while (count > 0) {
+        size_t pfn = region_pfn(region, idx);
+        unsigned order = 0;
+        while (order < PMM_MAX_ORDER && !(pfn & ((size_t)1 << order)) &&
+               ((size_t)2 << order) <= count) {
+            order++;
+        }
+        buddy_free_block(region, idx, order);
+        idx += (size_t)1 << order;
+        count -= (size_t)1 << order;
+    }
+}
+
+// Take a block of the given order off the free lists, splitting larger blocks
+static size_t buddy_alloc_block(pmm_region_t *region, unsigned order) {
+    unsigned k = order;
+    while (k <= PMM_MAX_ORDER && region->free_area[k].head == BUDDY_NONE) k++;
+    if (k > PMM_MAX_ORDER) return BUDDY_NONE;
+
+    size_t idx = region->free_area[k].head;
+    buddy_list_del(region, idx, k);
+    while (k > order) {
+        k--;
+        buddy_list_add(region, idx + ((size_t)1 << k), k);
+    }
+    return idx;
+}
+
+// First allocated page in [start, end), or end if the run is entirely free
+static size_t find_next_used_page(const pmm_region_t *region, size_t start, size_t end) {
+    while (start < end) {
+        size_t word = start / 64;
+        uint64_t used_bits = region->bitmap[word] & (~0ULL << (start % 64));
+        if (used_bits) {
+            size_t idx = word * 64 + ctz64(used_bits);
+            return idx < end ? idx : end;
+        }
+        start = (word + 1) * 64;
+    }
+    return end;
+}
+
+// Find count free pages whose first frame is a multiple of align_pages and
+// which do not straddle a multiple of boundary_pages (0 means no boundary).
+// Candidates jump past each allocated page and are checked a word at a time.
+static size_t find_free_run(const pmm_region_t *region, size_t count,
+                            size_t align_pages, size_t boundary_pages) {
+    size_t base_pfn = region->base / PMM_PAGE_SIZE;
+    size_t idx = find_next_free_page(region, 0, region->pages);
+
+    while (idx + count <= region->pages) {
+        size_t pfn = (base_pfn + idx + align_pages - 1) & ~(align_pages - 1);
+        if (boundary_pages &&
+            (pfn & ~(boundary_pages - 1)) != ((pfn + count - 1) & ~(boundary_pages - 1))) {
+            pfn = (pfn + boundary_pages - 1) & ~(boundary_pages - 1);
+        }
+        idx = pfn - base_pfn;
+        if (idx + count > region->pages) break;
+
+        size_t used = find_next_used_page(region, idx, idx + count);
+        if (used == idx + count) return idx;
+        idx = find_next_free_page(region, used + 1, region->pages);
+    }
+    return BUDDY_NONE;
+}
+
+// Head of the free block holding page idx, or BUDDY_NONE, in O(MAX_ORDER)
+static size_t buddy_find_block(const pmm_region_t *region, size_t idx, unsigned *order_out) {
+    size_t base_pfn = region->base / PMM_PAGE_SIZE;
+    size_t pfn = base_pfn + idx;
+
+    for (unsigned k = 0; k <= PMM_MAX_ORDER; k++) {
+        size_t head_pfn = pfn & ~(((size_t)1 << k) - 1);
+        if (head_pfn < base_pfn) break;
+
+        size_t head = head_pfn - base_pfn;
+        unsigned order = region->order_map[head];
+        if (order == 0 || order - 1 < k) continue;
+
+        *order_out = order - 1;
+        return head;
+    }
+    return BUDDY_NONE;
+}
+
+// Remove one free page from whichever buddy block holds it
+static void buddy_claim_page(pmm_region_t *region, size_t idx) {
+    unsigned order;
+    size_t head = buddy_find_block(region, idx, &order);
+    if (head == BUDDY_NONE) return;
+
+    buddy_list_del(region, head, order);
+    while (order > 0) {
+        order--;
+        size_t half = (size_t)1 << order;
+        if (idx >= head + half) {
+            buddy_list_add(region, head, order);
+            head += half;
+        } else {
+            buddy_list_add(region, head + half, order);
+        }
+    }
+}
+
+// Remove every free page in [start, start + count) from the buddy lists,
+// one whole block at a time; parts of a block outside the range go back
+static void buddy_claim_range(pmm_region_t *region, size_t start, size_t count) {
+    size_t end = start + count;
+    size_t idx = find_next_free_page(region, start, end);
+
+    while (idx < end) {
+        unsigned order;
+        size_t head = buddy_find_block(region, idx, &order);
+        if (head == BUDDY_NONE) {
+            idx = find_next_free_page(region, idx + 1, end);
+            continue;
+        }
+
+        size_t block_end = head + ((size_t)1 << order);
+        buddy_list_del(region, head, order);
+        if (head < start) {
+            buddy_free_range(region, head, start - head);
+        }
+        if (block_end > end) {
+            buddy_free_range(region, end, block_end - end);
+        }
+        idx = find_next_free_page(region, block_end, end);
+    }
+}
+
+// Find a free page of one color. With up to 64 colors the pages of a color
+// form the same bit pattern in every bitmap word; with more, they sit at a
+// single bit of every (colors / 64)-th word.
+static size_t find_free_colored(const pmm_region_t *region, unsigned color) {
+    size_t first = (color - region_pfn(region, 0)) & (color_count - 1);
+
+    if (color_count <= 64) {
+        uint64_t mask = 0;
+        for (size_t bit = first; bit < 64; bit += color_count) {
+            mask |= 1ULL << bit;
+        }
+        for (size_t word = find_free_word(region, 0); word < region->bitmap_size;
+             word = find_free_word(region, word + 1)) {
+            uint64_t hit = ~region->bitmap[word] & mask;
+            if (hit) return word * 64 + ctz64(hit);
+        }
+        return BUDDY_NONE;
+    }
+
+    uint64_t bit = 1ULL << (first % 64);
+    for (size_t word = first / 64; word < region->bitmap_size; word += color_count / 64) {
+        if (!(region->bitmap[word] & bit)) return word * 64 + first % 64;
+    }
+    return BUDDY_NONE;
 }
 
-// Find region containing the given address
+// Find region containing the given address: one section table lookup
 static pmm_region_t* find_region_for_addr(uintptr_t addr) {
-    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
-        if (addr >= region->base && 
-            addr < region->base + region->pages * PMM_PAGE_SIZE) {
-            return region;
+    pmm_region_t *region = pmm_sections[addr >> PMM_SECTION_SHIFT];
+
+    if (region == PMM_SECTION_SHARED) {
+        for (region = pmm_regions; region; region = region->next) {
+            if (addr >= region->base && 
+                addr < region->base + region->pages * PMM_PAGE_SIZE) {
+                return region;
+            }
         }
+        return NULL;
+    }
+    if (region && addr >= region->base &&
+        addr < region->base + region->pages * PMM_PAGE_SIZE) {
+        return region;
     }
     return NULL;
 }
 
+// Point every section the region overlaps at it
+static void register_sections(pmm_region_t *region) {
+    size_t first = region->base >> PMM_SECTION_SHIFT;
+    size_t last = (region->base + region->pages * PMM_PAGE_SIZE - 1) >> PMM_SECTION_SHIFT;
+
+    for (size_t section = first; section <= last; section++) {
+        pmm_sections[section] = pmm_sections[section] ? PMM_SECTION_SHARED : region;
+    }
+}
+
+// Page database updates as frames leave and re-enter the allocator. Frames
+// parked in magazines or the zero pool keep a zero refcount.
+static void vm_pages_hand_out(pmm_region_t *region, size_t start, size_t count, uint8_t flags) {
+    for (vm_page_t *page = &region->vm_pages[start]; count--; page++) {
+        page->refcount = 1;
+        page->flags = flags;
+        page->owner = 0;
+    }
+}
+
+static void vm_pages_release(pmm_region_t *region, size_t start, size_t count) {
+    for (vm_page_t *page = &region->vm_pages[start]; count--; page++) {
+        page->refcount = 0;
+        page->flags = 0;
+        page->owner = 0;
+    }
+}
+
+// Record a successful allocation of count frames at addr
+static void* pages_allocated(void *addr, size_t count) {
+    if (addr) {
+        pmm_region_t *region = find_region_for_addr((uintptr_t)addr);
+        vm_pages_hand_out(region, ((uintptr_t)addr - region->base) / PMM_PAGE_SIZE, count, 0);
+    }
+    return addr;
+}
+
 // Initialize PMM subsystem
 int pmm_init(void) {
     if (pmm_initialized) {
@@ -58,7 +484,25 @@ int pmm_init(void) {
     pmm_regions = NULL;
     pmm_initialized = true;
     
+    // Background zeroing streams past the cache when SSE2 (MOVNTI) is there
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    zero_use_movnti = (edx >> 26) & 1;
+    
+    // One color per page that fits in a single way of the L2 (or the
+    // last-level cache when no L2 is reported)
+    cpu_cache_info_t cache;
+    cpu_detect_cache(&cache);
+    const cpu_cache_level_t *level = cache.l2.sets ? &cache.l2 : &cache.llc;
+    size_t colors = (size_t)level->sets * level->line_size / PMM_PAGE_SIZE;
+    color_count = 1;
+    while (color_count * 2 <= colors && color_count < PMM_MAX_COLORS) {
+        color_count *= 2;
+    }
+    
     printf("pmm: Physical Memory Manager initialized\n");
+    printf("pmm: %u page colors (%u KB %u-way cache)\n",
+           color_count, level->size / 1024, level->ways);
     return 0;
 }
 
@@ -68,8 +512,12 @@ int pmm_add_region(uintptr_t base, size_t size, pmm_zone_t zone) {
         return -1;
     }
     
-    // Align base and size to page boundaries
+    // Align base and size to page boundaries; a range that ends before its
+    // first page boundary holds no whole page
     uintptr_t aligned_base = pmm_page_align_up(base);
+    if (aligned_base < base || aligned_base - base >= size) {
+        return -1;
+    }
     size_t aligned_size = pmm_page_align_down(size - (aligned_base - base));
     size_t pages = aligned_size / PMM_PAGE_SIZE;
     
@@ -77,25 +525,70 @@ int pmm_add_region(uintptr_t base, size_t size, pmm_zone_t zone) {
         return -1; // Region too small
     }
     
-    // Allocate region descriptor (you'll need to implement a simple allocator for this)
-    pmm_region_t *region = malloc(sizeof(pmm_region_t));
-    if (!region) return -1;
-    
-    // Calculate bitmap size (in 64-bit words)
+    // Carve the descriptor, bitmaps, page database and buddy arrays out of
+    // the region itself
     size_t bitmap_size = (pages + 63) / 64;
-    region->bitmap = calloc(bitmap_size, sizeof(uint64_t));
-    if (!region->bitmap) {
-        free(region);
-        return -1;
+    size_t summary_size = (bitmap_size + 63) / 64;
+    size_t bitmap_off = (sizeof(pmm_region_t) + 7) & ~(size_t)7;
+    size_t summary_off = bitmap_off + bitmap_size * sizeof(uint64_t);
+    size_t vm_pages_off = summary_off + summary_size * sizeof(uint64_t);
+    size_t links_off = vm_pages_off + pages * sizeof(vm_page_t);
+    size_t order_off = links_off + pages * sizeof(pmm_buddy_link_t);
+    size_t meta_pages = pmm_page_align_up(order_off + pages) / PMM_PAGE_SIZE;
+    
+    if (meta_pages >= pages) {
+        return -1; // Region cannot hold its own metadata
+    }
+    
+    uint8_t *meta = (uint8_t *)aligned_base;
+    memset(meta, 0, links_off);         // Descriptor, bitmaps and page database
+    memset(meta + order_off, 0, pages); // Links are only read for free block heads
+    
+    pmm_region_t *region = (pmm_region_t *)meta;
+    region->bitmap = (uint64_t *)(meta + bitmap_off);
+    region->summary = (uint64_t *)(meta + summary_off);
+    region->links = (pmm_buddy_link_t *)(meta + links_off);
+    region->vm_pages = (vm_page_t *)(meta + vm_pages_off);
+    region->order_map = meta + order_off;
+    
+    for (size_t i = 0; i < pages; i++) {
+        region->vm_pages[i].zone = zone;
+    }
+    vm_pages_hand_out(region, 0, meta_pages, VM_PAGE_RESERVED);
+    
+    // Metadata pages, and bits past the last page, read as allocated
+    for (size_t word = 0; word < meta_pages / 64; word++) {
+        region->bitmap[word] = ~0ULL;
+    }
+    if (meta_pages % 64) {
+        region->bitmap[meta_pages / 64] = word_mask(0, meta_pages % 64);
+    }
+    if (pages % 64) {
+        region->bitmap[bitmap_size - 1] |= ~0ULL << (pages % 64);
+    }
+    for (size_t word = 0; word < bitmap_size; word++) {
+        if (region->bitmap[word] != ~0ULL) {
+            set_bit_64(region->summary, word);
+        }
     }
     
     region->base = aligned_base;
     region->pages = pages;
     region->bitmap_size = bitmap_size;
-    region->last_alloc = 0;
+    region->summary_size = summary_size;
+    region->free_pages = pages - meta_pages;
+    region->last_alloc = meta_pages;
     region->zone = zone;
+    for (unsigned order = 0; order <= PMM_MAX_ORDER; order++) {
+        region->free_area[order].head = BUDDY_NONE;
+        region->free_area[order].count = 0;
+    }
+    buddy_free_range(region, meta_pages, pages - meta_pages);
+    zone_pages[zone] += pages;
+    zone_free[zone] += pages - meta_pages;
     region->next = pmm_regions;
     pmm_regions = region;
+    register_sections(region);
     
     printf("pmm: Added region 0x%08lx - 0x%08lx (%zu pages, zone %d)\n",
            aligned_base, aligned_base + pages * PMM_PAGE_SIZE, pages, zone);
@@ -103,6 +596,8 @@ int pmm_add_region(uintptr_t base, size_t size, pmm_zone_t zone) {
     return 0;
 }
 
+static void zero_pool_release(pmm_zone_t zone);
+
 // Reserve a range of memory (mark as allocated)
 int pmm_reserve_range(uintptr_t start, uintptr_t end) {
     if (!pmm_initialized) {
@@ -112,57 +607,96 @@ int pmm_reserve_range(uintptr_t start, uintptr_t end) {
     uintptr_t aligned_start = pmm_page_align_down(start);
     uintptr_t aligned_end = pmm_page_align_up(end);
     
-    for (uintptr_t addr = aligned_start; addr < aligned_end; addr += PMM_PAGE_SIZE) {
-        pmm_region_t *region = find_region_for_addr(addr);
-        if (region) {
-            size_t page_idx = (addr - region->base) / PMM_PAGE_SIZE;
-            if (page_idx < region->pages) {
-                set_bit_64(region->bitmap, page_idx);
-            }
-        }
+    // A cached frame looks allocated; push them back so none escape the reservation
+    pmm_drain_magazines();
+    for (int zone = 0; zone < PMM_ZONE_COUNT; zone++) {
+        zero_pool_release(zone);
+    }
+    
+    // Clip the range against each region and reserve whole bitmap words
+    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
+        uintptr_t region_end = region->base + region->pages * PMM_PAGE_SIZE;
+        uintptr_t lo = aligned_start > region->base ? aligned_start : region->base;
+        uintptr_t hi = aligned_end < region_end ? aligned_end : region_end;
+        if (lo >= hi) continue;
+        
+        size_t first = (lo - region->base) / PMM_PAGE_SIZE;
+        size_t count = (hi - lo) / PMM_PAGE_SIZE;
+        buddy_claim_range(region, first, count);
+        region_mark_used_range(region, first, count);
+        vm_pages_hand_out(region, first, count, VM_PAGE_RESERVED);
     }
     
     printf("pmm: Reserved range 0x%08lx - 0x%08lx\n", aligned_start, aligned_end);
     return 0;
 }
 
-// Fast allocation within a region using bitmap scanning
+// Fast allocation within a region: the summary bitmap locates a word with a
+// free page, then one trailing-zero count picks the page inside it
 static void* alloc_page_from_region(pmm_region_t *region) {
-    size_t start_word = region->last_alloc / 64;
-    
-    // Search from last allocation point
-    for (size_t word_idx = start_word; word_idx < region->bitmap_size; word_idx++) {
-        uint64_t word = region->bitmap[word_idx];
-        if (word != ~0ULL) { // Not all bits set
-            int bit_offset = find_first_zero_bit_64(word);
-            if (bit_offset < 64) {
-                size_t page_idx = word_idx * 64 + bit_offset;
-                if (page_idx < region->pages) {
-                    set_bit_64(region->bitmap, page_idx);
-                    region->last_alloc = page_idx;
-                    return (void*)(region->base + page_idx * PMM_PAGE_SIZE);
-                }
-            }
+    if (region->free_pages == 0) return NULL;
+
+    size_t word_idx = find_free_word(region, region->last_alloc / 64);
+    if (word_idx >= region->bitmap_size) {
+        word_idx = find_free_word(region, 0);  // Wrap around to beginning
+        if (word_idx >= region->bitmap_size) return NULL;
+    }
+
+    size_t page_idx = word_idx * 64 + find_first_zero_bit_64(region->bitmap[word_idx]);
+    region_mark_used(region, page_idx);
+    buddy_claim_page(region, page_idx);
+    region->last_alloc = page_idx;
+    return (void*)(region->base + page_idx * PMM_PAGE_SIZE);
+}
+
+// Pull a batch of frames from one zone into a magazine, walking the
+// region list once per batch instead of once per page
+static void magazine_refill(pmm_magazine_t *mag, pmm_zone_t zone) {
+    for (pmm_region_t *region = pmm_regions;
+         region && mag->count < PMM_MAGAZINE_BATCH; region = region->next) {
+        if (region->zone != zone) continue;
+        while (mag->count < PMM_MAGAZINE_BATCH) {
+            void *page = alloc_page_from_region(region);
+            if (!page) break;
+            mag->frames[mag->count++] = (uintptr_t)page;
+            zone_cached[zone]++;
         }
     }
-    
-    // Wrap around to beginning
-    for (size_t word_idx = 0; word_idx < start_word; word_idx++) {
-        uint64_t word = region->bitmap[word_idx];
-        if (word != ~0ULL) {
-            int bit_offset = find_first_zero_bit_64(word);
-            if (bit_offset < 64) {
-                size_t page_idx = word_idx * 64 + bit_offset;
-                if (page_idx < region->pages) {
-                    set_bit_64(region->bitmap, page_idx);
-                    region->last_alloc = page_idx;
-                    return (void*)(region->base + page_idx * PMM_PAGE_SIZE);
-                }
-            }
+}
+
+static int free_pages_to_region(pmm_region_t *region, uintptr_t target, size_t count);
+
+// Return the oldest half of a magazine to the zone allocator
+static void magazine_drain(pmm_magazine_t *mag, pmm_zone_t zone, size_t batch) {
+    if (batch > mag->count) batch = mag->count;
+
+    for (size_t i = 0; i < batch; i++) {
+        uintptr_t frame = mag->frames[i];
+        free_pages_to_region(find_region_for_addr(frame), frame, 1);
+    }
+    for (size_t i = batch; i < mag->count; i++) {
+        mag->frames[i - batch] = mag->frames[i];
+    }
+    mag->count -= batch;
+    zone_cached[zone] -= batch;
+}
+
+// Take frame i out of the zero pool
+static uintptr_t zero_pool_remove(size_t i) {
+    uintptr_t frame = zero_pool.frames[i];
+    zero_pool.frames[i] = zero_pool.frames[--zero_pool.count];
+    zone_pooled[find_region_for_addr(frame)->zone]--;
+    return frame;
+}
+
+// Give a zone's pooled frames back to the zone allocator
+static void zero_pool_release(pmm_zone_t zone) {
+    for (size_t i = zero_pool.count; i-- > 0; ) {
+        pmm_region_t *region = find_region_for_addr(zero_pool.frames[i]);
+        if (region->zone == zone) {
+            free_pages_to_region(region, zero_pool_remove(i), 1);
         }
     }
-    
-    return NULL; // Region is full
 }
 
 // Allocate a single page from any zone
@@ -170,10 +704,21 @@ void* pmm_alloc_page(void) {
     return pmm_alloc_page_zone(PMM_ZONE_NORMAL);
 }
 
-// Allocate a single page from specific zone
-void* pmm_alloc_page_zone(pmm_zone_t zone) {
-    if (!pmm_initialized) {
-        return NULL;
+// Take one frame, preferring the given zone, without touching its page
+// database entry
+static void* alloc_page_zone(pmm_zone_t zone) {
+    unsigned cpu = pmm_this_cpu();
+    pmm_magazine_t *mag = &magazines[cpu][zone];
+    if (mag->count > 0) {
+        cpu_stats[cpu].hits++;
+    } else {
+        cpu_stats[cpu].misses++;
+        magazine_refill(mag, zone);
+        if (mag->count > 0) cpu_stats[cpu].refills++;
+    }
+    if (mag->count > 0) {
+        zone_cached[zone]--;
+        return (void*)mag->frames[--mag->count];
     }
     
     // Try preferred zone first
@@ -190,44 +735,203 @@ void* pmm_alloc_page_zone(pmm_zone_t zone) {
         if (page) return page;
     }
     
+    // Last resort: hand out a frame parked in the zeroed pool
+    if (zero_pool.count > 0) {
+        return (void*)zero_pool_remove(zero_pool.count - 1);
+    }
+    
     return NULL; // Out of memory
 }
 
+// Allocate a single page from specific zone
+void* pmm_alloc_page_zone(pmm_zone_t zone) {
+    if (!pmm_initialized) {
+        return NULL;
+    }
+    return pages_allocated(alloc_page_zone(zone), 1);
+}
+
+// Take one frame of a color from this CPU's magazine or the zone's
+// bitmaps, NULL if the zone has none left
+static void* alloc_page_color(pmm_zone_t zone, unsigned color) {
+    pmm_magazine_t *mag = &magazines[pmm_this_cpu()][zone];
+    for (size_t i = mag->count; i-- > 0; ) {
+        uintptr_t frame = mag->frames[i];
+        if (frame_color(frame) == color) {
+            mag->frames[i] = mag->frames[--mag->count];
+            zone_cached[zone]--;
+            return (void*)frame;
+        }
+    }
+    
+    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
+        if (region->zone != zone || region->free_pages == 0) continue;
+        
+        size_t idx = find_free_colored(region, color);
+        if (idx != BUDDY_NONE) {
+            region_mark_used(region, idx);
+            buddy_claim_page(region, idx);
+            return (void*)(region->base + idx * PMM_PAGE_SIZE);
+        }
+    }
+    return NULL;
+}
+
+unsigned pmm_color_count(void) {
+    return color_count;
+}
+
+// Allocate a page of color *hint and advance the hint, so a caller that
+// keeps its own hint spreads its pages over the cache. Falls back to any
+// color when the zone has none of the wanted one.
+void* pmm_alloc_page_color(pmm_zone_t zone, unsigned *hint) {
+    if (!pmm_initialized || zone >= PMM_ZONE_COUNT) {
+        return NULL;
+    }
+    
+    void *page = NULL;
+    if (color_count > 1 && hint) {
+        page = alloc_page_color(zone, (*hint)++ & (color_count - 1));
+        if (page) {
+            color_hits++;
+        } else {
+            color_misses++;
+        }
+    }
+    if (!page) {
+        page = alloc_page_zone(zone);
+    }
+    return pages_allocated(page, 1);
+}
+
 // Allocate multiple contiguous pages
 void* pmm_alloc_pages(size_t count) {
     return pmm_alloc_pages_zone(count, PMM_ZONE_NORMAL);
 }
 
+// Allocate count contiguous pages starting on an align_pages frame and not
+// crossing a boundary_pages frame. A buddy block of sufficient order is
+// naturally aligned and, when no larger than the boundary, cannot cross
+// it, so the free lists answer most requests; the unused tail of the
+// block goes straight back. Otherwise fall back to a word-wise run search.
+static void* alloc_run_from_region(pmm_region_t *region, size_t count,
+                                   size_t align_pages, size_t boundary_pages) {
+    if (region->free_pages < count) return NULL;
+
+    unsigned order = order_for_count(count);
+    while (((size_t)1 << order) < align_pages) order++;
+
+    if (order <= PMM_MAX_ORDER &&
+        (!boundary_pages || ((size_t)1 << order) <= boundary_pages)) {
+        size_t idx = buddy_alloc_block(region, order);
+        if (idx != BUDDY_NONE) {
+            size_t block = (size_t)1 << order;
+            if (block > count) {
+                buddy_free_range(region, idx + count, block - count);
+            }
+            region_mark_used_range(region, idx, count);
+            return (void*)(region->base + idx * PMM_PAGE_SIZE);
+        }
+    }
+
+    size_t idx = find_free_run(region, count, align_pages, boundary_pages);
+    if (idx == BUDDY_NONE) return NULL;
+
+    buddy_claim_range(region, idx, count);
+    region_mark_used_range(region, idx, count);
+    return (void*)(region->base + idx * PMM_PAGE_SIZE);
+}
+
+static void* alloc_run_from_zone(pmm_zone_t zone, size_t count,
+                                 size_t align_pages, size_t boundary_pages) {
+    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
+        if (region->zone != zone) continue;
+        
+        void *pages = alloc_run_from_region(region, count, align_pages, boundary_pages);
+        if (pages) return pages;
+    }
+    return NULL;
+}
+
+// Frames parked in magazines or the zero pool may be what splits the run:
+// hand them back and retry once
+static void* alloc_run_reclaim(pmm_zone_t zone, size_t count,
+                               size_t align_pages, size_t boundary_pages) {
+    void *pages = alloc_run_from_zone(zone, count, align_pages, boundary_pages);
+    if (!pages && (zone_cached[zone] > 0 || zone_pooled[zone] > 0)) {
+        pmm_drain_magazines();
+        zero_pool_release(zone);
+        pages = alloc_run_from_zone(zone, count, align_pages, boundary_pages);
+    }
+    return pages_allocated(pages, count);
+}
+
 void* pmm_alloc_pages_zone(size_t count, pmm_zone_t zone) {
-    if (!pmm_initialized || count == 0) {
+    if (!pmm_initialized || count == 0 || zone >= PMM_ZONE_COUNT) {
+        return NULL;
+    }
+    return alloc_run_reclaim(zone, count, 1, 0);
+}
+
+// Allocate count contiguous pages from one zone for a device: the run
+// starts on an align byte boundary and does not cross a multiple of
+// boundary bytes (0 for none), e.g. a 64 KB ISA DMA page
+void* pmm_alloc_constrained(size_t count, pmm_zone_t zone, size_t align, size_t boundary) {
+    if (!pmm_initialized || count == 0 || zone >= PMM_ZONE_COUNT) {
         return NULL;
     }
+    if (align < PMM_PAGE_SIZE) align = PMM_PAGE_SIZE;
+    if ((align & (align - 1)) || (boundary & (boundary - 1))) {
+        printf("[pmm] ERROR: Alignment and boundary must be powers of 2\n");
+        return NULL;
+    }
+    if (boundary && (boundary < PMM_PAGE_SIZE || count > boundary / PMM_PAGE_SIZE)) {
+        return NULL; // Cannot fit inside one boundary window
+    }
     
-    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
+    return alloc_run_reclaim(zone, count, align / PMM_PAGE_SIZE, boundary / PMM_PAGE_SIZE);
+}
+
+// Fill out[] with up to n independent pages from one zone and return how
+// many were allocated. Warm magazine frames go first; the rest come from a
+// single pass over each region's free bitmap words, claiming every wanted
+// run of free bits in a word at once.
+size_t pmm_alloc_bulk(size_t n, void **out, pmm_zone_t zone) {
+    if (!pmm_initialized || !out || zone >= PMM_ZONE_COUNT) {
+        return 0;
+    }
+    
+    size_t got = 0;
+    pmm_magazine_t *mag = &magazines[pmm_this_cpu()][zone];
+    while (got < n && mag->count > 0) {
+        zone_cached[zone]--;
+        out[got++] = pages_allocated((void*)mag->frames[--mag->count], 1);
+    }
+    
+    for (pmm_region_t *region = pmm_regions; region && got < n; region = region->next) {
         if (region->zone != zone) continue;
         
-        // Search for contiguous free pages
-        size_t consecutive = 0;
-        size_t start_page = 0;
-        
-        for (size_t i = 0; i < region->pages; i++) {
-            if (!test_bit_64(region->bitmap, i)) {
-                if (consecutive == 0) start_page = i;
-                consecutive++;
-                if (consecutive == count) {
-                    // Found enough consecutive pages, allocate them
-                    for (size_t j = start_page; j < start_page + count; j++) {
-                        set_bit_64(region->bitmap, j);
-                    }
-                    return (void*)(region->base + start_page * PMM_PAGE_SIZE);
+        for (size_t word = find_free_word(region, 0);
+             got < n && word < region->bitmap_size;
+             word = find_free_word(region, word + 1)) {
+            uint64_t take = ~region->bitmap[word];
+            while (take && got < n) {
+                size_t bit = ctz64(take);
+                size_t run = ctz64(~(take >> bit));
+                if (run > n - got) run = n - got;
+                take &= ~word_mask(bit, bit + run);
+                
+                size_t idx = word * 64 + bit;
+                buddy_claim_range(region, idx, run);
+                region_mark_used_range(region, idx, run);
+                vm_pages_hand_out(region, idx, run, 0);
+                for (size_t i = 0; i < run; i++) {
+                    out[got++] = (void*)(region->base + (idx + i) * PMM_PAGE_SIZE);
                 }
-            } else {
-                consecutive = 0;
             }
         }
     }
-    
-    return NULL; // No contiguous block found
+    return got;
 }
 
 // Free a single page
@@ -235,6 +939,52 @@ int pmm_free_page(void* addr) {
     return pmm_free_pages(addr, 1);
 }
 
+static int free_pages_to_region(pmm_region_t *region, uintptr_t target, size_t count) {
+    size_t start_page = (target - region->base) / PMM_PAGE_SIZE;
+    if (start_page + count > region->pages) {
+        printf("[pmm] ERROR: Free range extends beyond region boundary\n");
+        return -1;
+    }
+    
+    // Check for double-free
+    if (!region_range_allocated(region, start_page, count)) {
+        printf("[pmm] WARNING: Double-free detected in pages %zu-%zu\n",
+               start_page, start_page + count - 1);
+        return -1;
+    }
+    
+    // Free the pages and hand them back to the buddy lists
+    region_mark_free_range(region, start_page, count);
+    buddy_free_range(region, start_page, count);
+    
+    // Update allocation hint
+    if (start_page < region->last_alloc) {
+        region->last_alloc = start_page;
+    }
+    
+    return 0;
+}
+
+// Park a single freed frame in this CPU's magazine
+static int free_page_to_magazine(pmm_region_t *region, uintptr_t target) {
+    size_t page_idx = (target - region->base) / PMM_PAGE_SIZE;
+    unsigned cpu = pmm_this_cpu();
+    pmm_magazine_t *mag = &magazines[cpu][region->zone];
+    
+    if (!test_bit_64(region->bitmap, page_idx)) {
+        printf("[pmm] WARNING: Double-free detected at page %zu\n", page_idx);
+        return -1;
+    }
+    
+    if (mag->count == PMM_MAGAZINE_SIZE) {
+        magazine_drain(mag, region->zone, PMM_MAGAZINE_BATCH);
+        cpu_stats[cpu].drains++;
+    }
+    mag->frames[mag->count++] = target;
+    zone_cached[region->zone]++;
+    return 0;
+}
+
 // Free multiple pages
 int pmm_free_pages(void* addr, size_t count) {
     if (!pmm_initialized || !addr || count == 0) {
@@ -253,34 +1003,233 @@ int pmm_free_pages(void* addr, size_t count) {
         return -1;
     }
     
-    size_t start_page = (target - region->base) / PMM_PAGE_SIZE;
-    if (start_page + count > region->pages) {
-        printf("[pmm] ERROR: Free range extends beyond region boundary\n");
+    // Shared frames go back through pmm_page_put. A frame with no
+    // references is already free, even if it still sits in a magazine or
+    // the zero pool with its bitmap bit set.
+    size_t first = (target - region->base) / PMM_PAGE_SIZE;
+    for (size_t i = 0; i < count && first + i < region->pages; i++) {
+        uint16_t refs = region->vm_pages[first + i].refcount;
+        if (refs == 0) {
+            printf("[pmm] WARNING: Double-free detected at page %zu\n", first + i);
+            return -1;
+        }
+        if (refs > 1) {
+            printf("[pmm] ERROR: Freeing shared frame 0x%08lx\n",
+                   target + i * PMM_PAGE_SIZE);
+            return -1;
+        }
+    }
+    
+    int result = count == 1 ? free_page_to_magazine(region, target)
+                            : free_pages_to_region(region, target, count);
+    if (result == 0) {
+        vm_pages_release(region, first, count);
+    }
+    return result;
+}
+
+// Free an array of pages, handing back each run of adjacent frames within
+// a region in one call. Returns -1 if any page could not be freed.
+int pmm_free_bulk(void **pages, size_t n) {
+    if (!pmm_initialized || !pages) {
         return -1;
     }
     
-    // Check for double-free
-    for (size_t i = 0; i < count; i++) {
-        if (!test_bit_64(region->bitmap, start_page + i)) {
-            printf("[pmm] WARNING: Double-free detected at page %zu\n", start_page + i);
-            return -1;
+    int result = 0;
+    for (size_t i = 0, run; i < n; i += run) {
+        uintptr_t start = (uintptr_t)pages[i];
+        pmm_region_t *region = find_region_for_addr(start);
+        uintptr_t region_end = region ? region->base + region->pages * PMM_PAGE_SIZE : 0;
+        
+        run = 1;
+        while (i + run < n && start + run * PMM_PAGE_SIZE < region_end &&
+               (uintptr_t)pages[i + run] == start + run * PMM_PAGE_SIZE) {
+            run++;
+        }
+        if (pmm_free_pages(pages[i], run) != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+// Flush every magazine back to the zone allocator
+void pmm_drain_magazines(void) {
+    for (unsigned cpu = 0; cpu < PMM_MAX_CPUS; cpu++) {
+        for (int zone = 0; zone < PMM_ZONE_COUNT; zone++) {
+            pmm_magazine_t *mag = &magazines[cpu][zone];
+            if (mag->count > 0) {
+                magazine_drain(mag, zone, mag->count);
+                cpu_stats[cpu].drains++;
+            }
+        }
+    }
+}
+
+int pmm_get_cpu_stats(unsigned cpu, pmm_cpu_stats_t *stats) {
+    if (cpu >= PMM_MAX_CPUS || !stats) {
+        return -1;
+    }
+    *stats = cpu_stats[cpu];
+    return 0;
+}
+
+// Clear a frame with non-temporal stores so idle zeroing does not evict
+// the working set
+static void zero_page_nocache(void *page) {
+    uint32_t *p = page;
+
+    for (size_t i = 0; i < PMM_PAGE_SIZE / sizeof(uint32_t); i += 4) {
+        asm volatile("movnti %1, 0(%0)\n\t"
+                     "movnti %1, 4(%0)\n\t"
+                     "movnti %1, 8(%0)\n\t"
+                     "movnti %1, 12(%0)"
+                     :: "r"(p + i), "r"(0) : "memory");
+    }
+    asm volatile("sfence" ::: "memory");
+}
+
+// Allocate a cleared page, from the pool when the idle loop has kept up
+void* pmm_alloc_zeroed_page(void) {
+    if (zero_pool.count > 0) {
+        uintptr_t frame = zero_pool_remove(zero_pool.count - 1);
+        zero_stats.hits++;
+        return pages_allocated((void*)frame, 1);
+    }
+    
+    // The caller is about to use the page, so clear it through the cache
+    void *page = pmm_alloc_page();
+    if (page) {
+        memset(page, 0, PMM_PAGE_SIZE);
+        zero_stats.misses++;
+    }
+    return page;
+}
+
+// Cleared page of color *hint, from the pool when it holds one
+void* pmm_alloc_zeroed_page_color(unsigned *hint) {
+    if (color_count > 1 && hint) {
+        unsigned color = *hint & (color_count - 1);
+        for (size_t i = 0; i < zero_pool.count; i++) {
+            uintptr_t frame = zero_pool.frames[i];
+            if (frame_color(frame) != color) continue;
+            
+            zero_pool_remove(i);
+            zero_stats.hits++;
+            color_hits++;
+            (*hint)++;
+            return pages_allocated((void*)frame, 1);
         }
     }
     
-    // Free the pages
-    for (size_t i = 0; i < count; i++) {
-        clear_bit_64(region->bitmap, start_page + i);
+    void *page = pmm_alloc_page_color(PMM_ZONE_NORMAL, hint);
+    if (page) {
+        memset(page, 0, PMM_PAGE_SIZE);
+        zero_stats.misses++;
+    }
+    return page;
+}
+
+// Zero one frame into the pool; called from the idle loop, so the work per
+// call is bounded to a single page and a full pool costs one compare. The
+// frame comes straight from a NORMAL region: the magazines and their
+// counters are left to real allocations, and scarce DMA frames are never
+// parked here.
+void pmm_idle_zero(void) {
+    if (!pmm_initialized || zero_pool.count >= PMM_ZERO_POOL_SIZE) {
+        return;
     }
     
-    // Update allocation hint
-    if (start_page < region->last_alloc) {
-        region->last_alloc = start_page;
+    void *page = NULL;
+    for (pmm_region_t *region = pmm_regions; region && !page; region = region->next) {
+        if (region->zone == PMM_ZONE_NORMAL) {
+            page = alloc_page_from_region(region);
+        }
     }
+    if (!page) return;
     
+    if (zero_use_movnti) {
+        zero_page_nocache(page);
+    } else {
+        memset(page, 0, PMM_PAGE_SIZE);
+    }
+    zero_pool.frames[zero_pool.count++] = (uintptr_t)page;
+    zone_pooled[find_region_for_addr((uintptr_t)page)->zone]++;
+    zero_stats.idle_bytes += PMM_PAGE_SIZE;
+}
+
+pmm_zero_stats_t pmm_get_zero_stats(void) {
+    return zero_stats;
+}
+
+// Page frame database entry for the frame holding addr
+vm_page_t* pmm_page_lookup(void* addr) {
+    if (!pmm_initialized) {
+        return NULL;
+    }
+    
+    pmm_region_t *region = find_region_for_addr((uintptr_t)addr);
+    if (!region) {
+        return NULL;
+    }
+    return &region->vm_pages[((uintptr_t)addr - region->base) / PMM_PAGE_SIZE];
+}
+
+// Take another reference to an allocated frame; returns the new count
+int pmm_page_get(void* addr) {
+    vm_page_t *page = pmm_page_lookup(addr);
+    if (!page || page->refcount == 0 || (page->flags & VM_PAGE_RESERVED)) {
+        printf("[pmm] ERROR: Cannot reference frame 0x%08lx\n", (uintptr_t)addr);
+        return -1;
+    }
+    if (page->refcount == UINT16_MAX) {
+        return -1;
+    }
+    return ++page->refcount;
+}
+
+// Drop a reference, freeing the frame with the last one; returns the
+// remaining count
+int pmm_page_put(void* addr) {
+    vm_page_t *page = pmm_page_lookup(addr);
+    if (!page || page->refcount == 0 || (page->flags & VM_PAGE_RESERVED)) {
+        printf("[pmm] ERROR: Cannot release frame 0x%08lx\n", (uintptr_t)addr);
+        return -1;
+    }
+    if (page->refcount > 1) {
+        return --page->refcount;
+    }
+    return pmm_free_page((void*)pmm_page_align_down((uintptr_t)addr)) == 0 ? 0 : -1;
+}
+
+// Tag count allocated frames starting at addr with a subsystem owner
+int pmm_page_set_owner(void* addr, size_t count, uint32_t owner) {
+    for (size_t i = 0; i < count; i++) {
+        vm_page_t *page = pmm_page_lookup((uint8_t *)addr + i * PMM_PAGE_SIZE);
+        if (!page || page->refcount == 0) {
+            return -1;
+        }
+        page->owner = owner;
+    }
     return 0;
 }
 
-// Check if a page is allocated
+// Count the frames charged to an owner tag (walks the page database)
+size_t pmm_owner_pages(uint32_t owner) {
+    size_t total = 0;
+    
+    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
+        for (size_t i = 0; i < region->pages; i++) {
+            if (region->vm_pages[i].refcount && region->vm_pages[i].owner == owner) {
+                total++;
+            }
+        }
+    }
+    return total;
+}
+
+// Check if a page is allocated. Frames parked in a magazine or the zero
+// pool keep their bitmap bit but have no references.
 bool pmm_is_page_allocated(void* addr) {
     if (!pmm_initialized || !addr) {
         return false;
@@ -293,10 +1242,10 @@ bool pmm_is_page_allocated(void* addr) {
     }
     
     size_t page_idx = (target - region->base) / PMM_PAGE_SIZE;
-    return test_bit_64(region->bitmap, page_idx);
+    return test_bit_64(region->bitmap, page_idx) && region->vm_pages[page_idx].refcount > 0;
 }
 
-// Get memory statistics
+// Get memory statistics from the running counters, O(zones)
 pmm_stats_t pmm_get_stats(void) {
     pmm_stats_t stats = {0};
     
@@ -304,27 +1253,27 @@ pmm_stats_t pmm_get_stats(void) {
         return stats;
     }
     
-    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
-        stats.total_pages += region->pages;
-        stats.zones_pages[region->zone] += region->pages;
-        
-        // Count allocated pages
-        size_t allocated = 0;
-        for (size_t i = 0; i < region->pages; i++) {
-            if (test_bit_64(region->bitmap, i)) {
-                allocated++;
-            }
-        }
-        
-        stats.allocated_pages += allocated;
-        size_t free = region->pages - allocated;
-        stats.free_pages += free;
-        stats.zones_free[region->zone] += free;
+    for (int zone = 0; zone < PMM_ZONE_COUNT; zone++) {
+        stats.zones_pages[zone] = zone_pages[zone];
+        stats.zones_free[zone] = zone_free[zone] + zone_cached[zone] + zone_pooled[zone];
+        stats.total_pages += zone_pages[zone];
+        stats.free_pages += stats.zones_free[zone];
     }
+    stats.allocated_pages = stats.total_pages - stats.free_pages;
     
     return stats;
 }
 
+// End of the highest region, i.e. how far a direct map of RAM must reach
+uintptr_t pmm_highest_address(void) {
+    uintptr_t top = 0;
+    for (pmm_region_t *region = pmm_regions; region; region = region->next) {
+        uintptr_t end = region->base + region->pages * PMM_PAGE_SIZE;
+        if (end > top) top = end;
+    }
+    return top;
+}
+
 // Dump detailed state information
 void pmm_dump_state(void) {
     if (!pmm_initialized) {
@@ -338,15 +1287,16 @@ void pmm_dump_state(void) {
                region->base, region->base + region->pages * PMM_PAGE_SIZE,
                region->pages, region->zone);
         
-        size_t allocated = 0;
-        for (size_t i = 0; i < region->pages; i++) {
-            if (test_bit_64(region->bitmap, i)) {
-                allocated++;
-            }
-        }
+        size_t allocated = region->pages - region->free_pages;
         printf("    Allocated: %zu/%zu pages (%.1f%%)\n",
                allocated, region->pages, 
                (float)allocated / region->pages * 100.0f);
+
+        printf("    Free blocks by order:");
+        for (unsigned order = 0; order <= PMM_MAX_ORDER; order++) {
+            printf(" %zu", region->free_area[order].count);
+        }
+        printf("\n");
     }
 }
 
@@ -370,4 +1320,17 @@ void pmm_dump_stats(void) {
                    (float)stats.zones_free[i] / stats.zones_pages[i] * 100.0f);
         }
     }
+    
+    for (unsigned cpu = 0; cpu < PMM_MAX_CPUS; cpu++) {
+        pmm_cpu_stats_t *cs = &cpu_stats[cpu];
+        if (cs->hits + cs->misses == 0) continue;
+        printf("  cpu%u magazine: %zu hits, %zu misses, %zu refills, %zu drains\n",
+               cpu, cs->hits, cs->misses, cs->refills, cs->drains);
+    }
+    
+    printf("  Zero pool: %zu ready, %zu hits, %zu misses, %zu KB zeroed while idle\n",
+           zero_pool.count, zero_stats.hits, zero_stats.misses,
+           (size_t)(zero_stats.idle_bytes / 1024));
+    printf("  Page colors: %u, %zu colored allocations, %zu fell back\n",
+           color_count, color_hits, color_misses);
 }
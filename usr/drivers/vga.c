@@ -4,7 +4,7 @@
 #include <stdarg.h>
 
 // VGA memory address
-#define VGA_MEMORY_ADDR ((uint16_t*) 0xB8000)
+#define VGA_MEMORY_ADDR ((uint16_t*) VGA_TEXT_PHYS)
 static uint16_t* const VGA_MEMORY = VGA_MEMORY_ADDR;
 
 // Cursor control ports
@@ -1,287 +1,530 @@
 #include <vmm.h>
+#include <pmm.h>
+#include <paging.h>
+#include <machine/pte.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
-#include <math.h>
 
-static vmm_page_t page_table[VMM_MAX_PAGES];
+#define EXTENTS_PER_PAGE (VMM_PAGE_SIZE / sizeof(vmm_extent_t))
+
+static vmm_arena_t arenas[VMM_MAX_ARENAS];
+static vmm_arena_t *kernel_arena = NULL;
+
+// Extent descriptors are carved from PMM pages as arenas need them and
+// recycled through a free list, so metadata tracks the number of extents
+// rather than the size of the address space
+static vmm_extent_t *extent_free_list = NULL;
+static size_t extent_pages = 0;
+
+static vmm_fault_stats_t fault_stats;
 static bool vmm_initialized = false;
 
-void vmm_init(void) {
-    if (vmm_initialized) return;
-    
-    memset(page_table, 0, sizeof(page_table));
-    for (size_t i = 0; i < VMM_MAX_PAGES; ++i) {
-        page_table[i].base_addr = VMM_BASE_ADDRESS + i * VMM_PAGE_SIZE;
-        page_table[i].size = VMM_PAGE_SIZE;
-        page_table[i].state = VMM_PAGE_FREE;
-        page_table[i].alloc_pages = 0;
-        page_table[i].tag = 0;
-        page_table[i].is_kernel = false;
+static int extent_cmp(const vmm_extent_t *a, const vmm_extent_t *b) {
+    return a->base < b->base ? -1 : a->base > b->base;
+}
+
+// Recompute the largest extent below a node and carry the change upward
+static void extent_augment(vmm_extent_t *node) {
+    while (node) {
+        size_t max = node->pages;
+        vmm_extent_t *left = RB_LEFT(node, link);
+        vmm_extent_t *right = RB_RIGHT(node, link);
+        if (left && left->max_pages > max) max = left->max_pages;
+        if (right && right->max_pages > max) max = right->max_pages;
+        if (node->max_pages == max) break;
+        node->max_pages = max;
+        node = RB_PARENT(node, link);
     }
-    vmm_initialized = true;
-    printf("vmm: Initialized %d pages (%.2f MB) starting at 0x%08x\n", 
-           VMM_MAX_PAGES, (VMM_MAX_PAGES * VMM_PAGE_SIZE) / (1024.0 * 1024.0),
-           (unsigned)VMM_BASE_ADDRESS);
 }
 
-void vmm_reserve_range(uintptr_t start, uintptr_t end) {
-    assert(vmm_initialized && "VMM not initialized");
-    
-    // Align addresses to page boundaries
-    start = start & ~(VMM_PAGE_SIZE - 1);
-    end = (end + VMM_PAGE_SIZE - 1) & ~(VMM_PAGE_SIZE - 1);
-    
-    for (size_t i = 0; i < VMM_MAX_PAGES; ++i) {
-        if (page_table[i].base_addr >= start && 
-            page_table[i].base_addr < end) {
-            page_table[i].state = VMM_PAGE_RESERVED;
-            page_table[i].tag = VMM_TAG_KERNEL;
-            page_table[i].is_kernel = true;
+#undef RB_AUGMENT
+#define RB_AUGMENT(x) extent_augment(x)
+
+RB_GENERATE_STATIC(vmm_extent_tree, vmm_extent, link, extent_cmp)
+
+// Ends are 64-bit so a range reaching the top of the 32-bit space does
+// not wrap to 0
+static inline uint64_t extent_end(const vmm_extent_t *extent) {
+    return (uint64_t)extent->base + (uint64_t)extent->pages * VMM_PAGE_SIZE;
+}
+
+static inline uint64_t arena_end(const vmm_arena_t *arena) {
+    return (uint64_t)arena->base + (uint64_t)arena->pages * VMM_PAGE_SIZE;
+}
+
+static vmm_extent_t *extent_new(vmm_arena_t *arena, uintptr_t base, size_t pages,
+                                vmm_page_state_t state) {
+    if (!extent_free_list) {
+        vmm_extent_t *slab = pmm_alloc_page();
+        if (!slab) {
+            printf("vmm: Error: Out of memory for extent descriptors\n");
+            return NULL;
+        }
+        pmm_page_set_owner(slab, 1, VMM_TAG_KERNEL);
+        extent_pages++;
+        for (size_t i = EXTENTS_PER_PAGE; i-- > 0; ) {
+            RB_LEFT(&slab[i], link) = extent_free_list;
+            extent_free_list = &slab[i];
         }
     }
+
+    vmm_extent_t *extent = extent_free_list;
+    extent_free_list = RB_LEFT(extent, link);
+
+    memset(extent, 0, sizeof(*extent));
+    extent->base = base;
+    extent->pages = pages;
+    extent->max_pages = pages;
+    extent->state = state;
+    arena->extents++;
+    return extent;
 }
 
-static void* vmm_alloc_internal(size_t pages_needed, size_t align, uint32_t tag, bool is_kernel) {
-    assert(vmm_initialized && "VMM not initialized");
-    assert(pages_needed > 0 && pages_needed <= VMM_MAX_PAGES);
-    
-    for (size_t i = 0; i <= VMM_MAX_PAGES - pages_needed; ++i) {
-        // Skip reserved pages
-        if (page_table[i].state == VMM_PAGE_RESERVED) continue;
-        
-        // Check alignment if requested
-        if (align > VMM_PAGE_SIZE) {
-            uintptr_t aligned_addr = (page_table[i].base_addr + align - 1) & ~(align - 1);
-            if (aligned_addr != page_table[i].base_addr) {
-                // Check if we have enough space after alignment
-                size_t offset_pages = (aligned_addr - page_table[i].base_addr) / VMM_PAGE_SIZE;
-                if (i + offset_pages + pages_needed > VMM_MAX_PAGES) {
-                    continue;
-                }
-                i += offset_pages - 1;  // -1 because loop will increment
-                continue;
-            }
+static void extent_delete(vmm_arena_t *arena, vmm_extent_t *extent) {
+    RB_LEFT(extent, link) = extent_free_list;
+    extent_free_list = extent;
+    arena->extents--;
+}
+
+// Extent of a tree containing addr, or NULL
+static vmm_extent_t *extent_lookup(struct vmm_extent_tree *tree, uintptr_t addr) {
+    vmm_extent_t *node = RB_ROOT(tree);
+
+    while (node) {
+        if (addr < node->base) {
+            node = RB_LEFT(node, link);
+        } else if (addr >= extent_end(node)) {
+            node = RB_RIGHT(node, link);
+        } else {
+            return node;
         }
-        
-        // Check if block is free
-        bool block_free = true;
-        for (size_t j = 0; j < pages_needed; ++j) {
-            if (page_table[i + j].state != VMM_PAGE_FREE) {
-                block_free = false;
-                i += j; // Skip past this used page
-                break;
-            }
+    }
+    return NULL;
+}
+
+// Lowest free extent that holds pages at the given alignment. Subtrees whose
+// largest extent is too small are skipped whole, so without an alignment
+// constraint this is a single O(log n) descent.
+static vmm_extent_t *extent_fit(vmm_extent_t *node, size_t pages, size_t align,
+                                uintptr_t *start) {
+    if (!node || node->max_pages < pages) return NULL;
+
+    vmm_extent_t *found = extent_fit(RB_LEFT(node, link), pages, align, start);
+    if (found) return found;
+
+    uintptr_t aligned = (node->base + align - 1) & ~(align - 1);
+    if (aligned >= node->base &&
+        (uint64_t)aligned + (uint64_t)pages * VMM_PAGE_SIZE <= extent_end(node)) {
+        *start = aligned;
+        return node;
+    }
+    return extent_fit(RB_RIGHT(node, link), pages, align, start);
+}
+
+// Take [start, start + pages) out of a free extent, returning what is left
+// on either side to the free tree
+static bool free_extent_split(vmm_arena_t *arena, vmm_extent_t *extent,
+                              uintptr_t start, size_t pages) {
+    uint64_t end = (uint64_t)start + (uint64_t)pages * VMM_PAGE_SIZE;
+    vmm_extent_t *tail = NULL;
+
+    if (end < extent_end(extent)) {
+        tail = extent_new(arena, (uintptr_t)end, (extent_end(extent) - end) / VMM_PAGE_SIZE,
+                          VMM_PAGE_FREE);
+        if (!tail) return false;
+    }
+
+    if (start > extent->base) {
+        // Shrinking in place keeps the address order
+        extent->pages = (start - extent->base) / VMM_PAGE_SIZE;
+        extent_augment(extent);
+    } else {
+        RB_REMOVE(vmm_extent_tree, &arena->free_tree, extent);
+        extent_delete(arena, extent);
+    }
+    if (tail) {
+        RB_INSERT(vmm_extent_tree, &arena->free_tree, tail);
+    }
+    return true;
+}
+
+// Return a range to the free tree, merging it with free neighbours
+static void free_range_insert(vmm_arena_t *arena, uintptr_t base, size_t pages) {
+    // A range ending at 4 GB has no successor
+    uint64_t end = (uint64_t)base + (uint64_t)pages * VMM_PAGE_SIZE;
+    vmm_extent_t key = { .base = (uintptr_t)end };
+    vmm_extent_t *next = end <= UINTPTR_MAX ? RB_NFIND(vmm_extent_tree, &arena->free_tree, &key)
+                                            : NULL;
+    vmm_extent_t *prev = next ? RB_PREV(vmm_extent_tree, &arena->free_tree, next)
+                              : RB_MAX(vmm_extent_tree, &arena->free_tree);
+
+    if (next && next->base != end) next = NULL;
+    if (prev && extent_end(prev) != base) prev = NULL;
+
+    if (prev && next) {
+        prev->pages += pages + next->pages;
+        RB_REMOVE(vmm_extent_tree, &arena->free_tree, next);
+        extent_delete(arena, next);
+        extent_augment(prev);
+    } else if (prev) {
+        prev->pages += pages;
+        extent_augment(prev);
+    } else if (next) {
+        next->base = base;  // Nothing lies between, so the order holds
+        next->pages += pages;
+        extent_augment(next);
+    } else {
+        vmm_extent_t *extent = extent_new(arena, base, pages, VMM_PAGE_FREE);
+        if (extent) {
+            RB_INSERT(vmm_extent_tree, &arena->free_tree, extent);
         }
-        
-        if (block_free) {
-            // Mark all pages as used
-            for (size_t j = 0; j < pages_needed; ++j) {
-                page_table[i + j].state = VMM_PAGE_USED;
-                page_table[i + j].alloc_pages = (j == 0) ? pages_needed : 0;
-                page_table[i + j].tag = tag;
-                page_table[i + j].is_kernel = is_kernel;
-            }
-            return (void*)page_table[i].base_addr;
+    }
+}
+
+// Arena whose range contains addr
+static vmm_arena_t *arena_for_addr(uintptr_t addr) {
+    for (size_t i = 0; i < VMM_MAX_ARENAS; i++) {
+        if (arenas[i].in_use && addr >= arenas[i].base && addr < arena_end(&arenas[i])) {
+            return &arenas[i];
         }
     }
-    
     return NULL;
 }
 
-void* vmm_alloc(size_t size) {
-    if (size == 0) return NULL;
-    
-    size_t pages_needed = (size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
-    if (pages_needed > VMM_MAX_PAGES) {
+// Manage [base, base + size) as a new arena with its own trees and counters
+vmm_arena_t* vmm_arena_create(uintptr_t base, size_t size) {
+    uint64_t end = (uint64_t)base + size;
+    uint64_t start = ((uint64_t)base + VMM_PAGE_SIZE - 1) & ~(uint64_t)(VMM_PAGE_SIZE - 1);
+
+    // Reject ranges past 4 GB and ones too small to hold an aligned page
+    if (size == 0 || end - 1 > UINTPTR_MAX || end < start + VMM_PAGE_SIZE) {
+        printf("vmm: Error: Invalid arena 0x%08x + %zu\n", (unsigned)base, size);
+        return NULL;
+    }
+    size_t pages = (end - start) / VMM_PAGE_SIZE;
+    for (size_t i = 0; i < VMM_MAX_ARENAS; i++) {
+        vmm_arena_t *other = &arenas[i];
+        if (other->in_use && start < arena_end(other) &&
+            other->base < start + (uint64_t)pages * VMM_PAGE_SIZE) {
+            printf("vmm: Error: Arena 0x%08x overlaps 0x%08x\n",
+                   (unsigned)start, (unsigned)other->base);
+            return NULL;
+        }
+    }
+
+    vmm_arena_t *arena = NULL;
+    for (size_t i = 0; i < VMM_MAX_ARENAS && !arena; i++) {
+        if (!arenas[i].in_use) arena = &arenas[i];
+    }
+    if (!arena) {
+        printf("vmm: Error: No free arena slots\n");
+        return NULL;
+    }
+
+    memset(arena, 0, sizeof(*arena));
+    arena->base = start;
+    arena->pages = pages;
+    RB_INIT(&arena->alloc_tree);
+    RB_INIT(&arena->free_tree);
+
+    vmm_extent_t *all = extent_new(arena, start, pages, VMM_PAGE_FREE);
+    if (!all) return NULL;
+    RB_INSERT(vmm_extent_tree, &arena->free_tree, all);
+    arena->in_use = true;
+    return arena;
+}
+
+// Release an arena that holds no allocations
+int vmm_arena_destroy(vmm_arena_t* arena) {
+    if (!arena || !arena->in_use || arena == kernel_arena) return -1;
+    if (arena->used_pages > 0) {
+        printf("vmm: Error: Arena 0x%08x still has allocations\n", (unsigned)arena->base);
+        return -1;
+    }
+
+    vmm_extent_t *extent, *next;
+    RB_FOREACH_SAFE(extent, vmm_extent_tree, &arena->alloc_tree, next) {
+        RB_REMOVE(vmm_extent_tree, &arena->alloc_tree, extent);
+        extent_delete(arena, extent);
+    }
+    RB_FOREACH_SAFE(extent, vmm_extent_tree, &arena->free_tree, next) {
+        RB_REMOVE(vmm_extent_tree, &arena->free_tree, extent);
+        extent_delete(arena, extent);
+    }
+    arena->in_use = false;
+    return 0;
+}
+
+vmm_arena_t* vmm_kernel_arena(void) {
+    return kernel_arena;
+}
+
+void vmm_init(void) {
+    if (vmm_initialized) return;
+
+    kernel_arena = vmm_arena_create(VMM_BASE_ADDRESS, VMM_KERNEL_SIZE);
+    if (!kernel_arena) return;
+
+    vmm_initialized = true;
+    printf("vmm: Initialized %zu pages (%zu MB) starting at 0x%08x\n",
+           kernel_arena->pages, kernel_arena->pages * VMM_PAGE_SIZE / (1024 * 1024),
+           (unsigned)VMM_BASE_ADDRESS);
+}
+
+static void arena_reserve(vmm_arena_t *arena, uintptr_t start, uint64_t end) {
+    // Carve every free extent overlapping the range
+    vmm_extent_t key = { .base = start };
+    vmm_extent_t *extent = RB_NFIND(vmm_extent_tree, &arena->free_tree, &key);
+    vmm_extent_t *prev = extent ? RB_PREV(vmm_extent_tree, &arena->free_tree, extent)
+                                : RB_MAX(vmm_extent_tree, &arena->free_tree);
+    if (prev && extent_end(prev) > start) extent = prev;
+
+    while (extent && extent->base < end) {
+        uintptr_t lo = extent->base > start ? extent->base : start;
+        uint64_t hi = extent_end(extent) < end ? extent_end(extent) : end;
+        vmm_extent_t *next = RB_NEXT(vmm_extent_tree, &arena->free_tree, extent);
+        size_t pages = (hi - lo) / VMM_PAGE_SIZE;
+
+        vmm_extent_t *reserved = extent_new(arena, lo, pages, VMM_PAGE_RESERVED);
+        if (!reserved) return;
+        if (!free_extent_split(arena, extent, lo, pages)) {
+            extent_delete(arena, reserved);
+            return;
+        }
+        reserved->tag = VMM_TAG_KERNEL;
+        reserved->is_kernel = true;
+        RB_INSERT(vmm_extent_tree, &arena->alloc_tree, reserved);
+        arena->reserved_pages += pages;
+
+        extent = next;
+    }
+}
+
+void vmm_reserve_range(uintptr_t start, uintptr_t end) {
+    if (!vmm_initialized) return;
+
+    // Align addresses to page boundaries
+    start = start & ~(VMM_PAGE_SIZE - 1);
+    uint64_t top = ((uint64_t)end + VMM_PAGE_SIZE - 1) & ~(uint64_t)(VMM_PAGE_SIZE - 1);
+
+    for (size_t i = 0; i < VMM_MAX_ARENAS; i++) {
+        if (arenas[i].in_use && start < arena_end(&arenas[i]) && arenas[i].base < top) {
+            arena_reserve(&arenas[i], start, top);
+        }
+    }
+}
+
+static void* vmm_alloc_internal(vmm_arena_t *arena, size_t pages_needed, size_t align,
+                                uint32_t tag, bool is_kernel) {
+    if (!arena || !arena->in_use || pages_needed == 0) return NULL;
+
+    if (pages_needed > arena->pages) {
         printf("vmm: Error: Requested size too large (%zu pages)\n", pages_needed);
         return NULL;
     }
-    
-    return vmm_alloc_internal(pages_needed, VMM_PAGE_SIZE, 0, false);
+    if (align < VMM_PAGE_SIZE) align = VMM_PAGE_SIZE;
+
+    uintptr_t start;
+    vmm_extent_t *free_extent = extent_fit(RB_ROOT(&arena->free_tree), pages_needed, align, &start);
+    if (!free_extent) return NULL;
+
+    vmm_extent_t *extent = extent_new(arena, start, pages_needed, VMM_PAGE_USED);
+    if (!extent) return NULL;
+    if (!free_extent_split(arena, free_extent, start, pages_needed)) {
+        extent_delete(arena, extent);
+        return NULL;
+    }
+
+    extent->tag = tag;
+    extent->is_kernel = is_kernel;
+    RB_INSERT(vmm_extent_tree, &arena->alloc_tree, extent);
+    arena->used_pages += pages_needed;
+    return (void*)start;
 }
 
-void* vmm_alloc_aligned(size_t size, size_t align) {
+void* vmm_arena_alloc(vmm_arena_t* arena, size_t size, size_t align, uint32_t tag, bool is_kernel) {
     if (size == 0) return NULL;
-    
+
     // Ensure alignment is power of 2
     if ((align & (align - 1)) != 0 || align == 0) {
         printf("vmm: Error: Alignment must be power of 2\n");
         return NULL;
     }
-    
+
     size_t pages_needed = (size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
-    if (pages_needed > VMM_MAX_PAGES) {
-        printf("vmm: Error: Requested size too large (%zu pages)\n", pages_needed);
-        return NULL;
-    }
-    
-    return vmm_alloc_internal(pages_needed, align, 0, false);
+    return vmm_alloc_internal(arena, pages_needed, align, tag, is_kernel);
+}
+
+void* vmm_alloc(size_t size) {
+    return vmm_arena_alloc(kernel_arena, size, VMM_PAGE_SIZE, 0, false);
+}
+
+void* vmm_alloc_aligned(size_t size, size_t align) {
+    return vmm_arena_alloc(kernel_arena, size, align, 0, false);
 }
 
 void* vmm_alloc_tagged(size_t size, uint32_t tag, bool is_kernel) {
-    if (size == 0) return NULL;
-    
-    size_t pages_needed = (size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
-    if (pages_needed > VMM_MAX_PAGES) {
-        printf("vmm: Error: Requested size too large (%zu pages)\n", pages_needed);
-        return NULL;
-    }
-    
-    return vmm_alloc_internal(pages_needed, VMM_PAGE_SIZE, tag, is_kernel);
+    return vmm_arena_alloc(kernel_arena, size, VMM_PAGE_SIZE, tag, is_kernel);
 }
 
 void vmm_free(void* addr) {
     if (!addr || !vmm_initialized) return;
 
     uintptr_t target = (uintptr_t)addr;
-    
-    // Find the first page of the allocation
-    for (size_t i = 0; i < VMM_MAX_PAGES; ++i) {
-        if (page_table[i].base_addr <= target && 
-            target < page_table[i].base_addr + page_table[i].size) {
-            
-            if (page_table[i].state != VMM_PAGE_USED) {
-                printf("vmm: Warning: Tried to free unallocated memory at 0x%08x\n", 
-                      (unsigned)target);
-                return;
-            }
+    vmm_arena_t *arena = arena_for_addr(target);
+    vmm_extent_t *extent = arena ? extent_lookup(&arena->alloc_tree, target) : NULL;
 
-            // Verify the allocation is valid before freeing
-            size_t pages = page_table[i].alloc_pages;
-            if (pages == 0 || i + pages > VMM_MAX_PAGES) {
-                printf("vmm: Error: Corrupted page table detected during free\n");
-                return;
-            }
+    if (!extent || extent->state != VMM_PAGE_USED) {
+        printf("vmm: Warning: Tried to free unallocated memory at 0x%08x\n",
+              (unsigned)target);
+        return;
+    }
+    if (target >= extent->base + VMM_PAGE_SIZE) {
+        printf("vmm: Error: 0x%08x is not the start of an allocation\n", (unsigned)target);
+        return;
+    }
 
-            // Free all pages in the allocation
-            for (size_t j = 0; j < pages; ++j) {
-                if (page_table[i + j].state != VMM_PAGE_USED) {
-                    printf("vmm: Error: Inconsistent page state during free\n");
-                    return;
-                }
-                page_table[i + j].state = VMM_PAGE_FREE;
-                page_table[i + j].alloc_pages = 0;
-                page_table[i + j].tag = 0;
-                page_table[i + j].is_kernel = false;
+    // Return the frames touched so far, then drop their mappings in one
+    // range walk with a single batched TLB flush. Nothing can reuse the
+    // frames in between. An untouched range costs nothing.
+    if (extent->resident > 0) {
+        size_t resident = extent->resident;
+        for (uintptr_t va = extent->base; resident > 0 && va < extent_end(extent);
+             va += VMM_PAGE_SIZE) {
+            uintptr_t frame = paging_get_physical(va);
+            if (frame) {
+                pmm_free_page((void*)frame);
+                resident--;
             }
-            return;
         }
+        paging_unmap_range(extent->base, extent->pages);
+        arena->resident_pages -= extent->resident;
+        fault_stats.resident_pages -= extent->resident;
+        extent->resident = 0;
     }
 
-    printf("vmm: Warning: Tried to free unallocated memory at 0x%08x\n", 
-          (unsigned)target);
+    RB_REMOVE(vmm_extent_tree, &arena->alloc_tree, extent);
+    arena->used_pages -= extent->pages;
+    free_range_insert(arena, extent->base, extent->pages);
+    extent_delete(arena, extent);
+}
+
+// Back the page holding addr with a zeroed frame on first touch. Returns
+// false for faults the VMM does not own: protection violations, or
+// addresses outside every allocation.
+bool vmm_handle_fault(uintptr_t addr, uint32_t error) {
+    vmm_arena_t *arena = arena_for_addr(addr);
+    vmm_extent_t *extent = arena ? extent_lookup(&arena->alloc_tree, addr) : NULL;
+
+    if ((error & PGEX_P) || !extent || extent->state != VMM_PAGE_USED) {
+        fault_stats.unhandled++;
+        return false;
+    }
+
+    void *frame = pmm_alloc_zeroed_page();
+    if (!frame) {
+        fault_stats.unhandled++;
+        return false;
+    }
+
+    uint32_t flags = PAGE_PRESENT | PAGE_WRITABLE | PAGE_NX | (extent->is_kernel ? 0 : PAGE_USER);
+    if (!paging_map_page(addr & ~(uintptr_t)(VMM_PAGE_SIZE - 1), (uintptr_t)frame, flags)) {
+        pmm_free_page(frame);
+        fault_stats.unhandled++;
+        return false;
+    }
+
+    extent->resident++;
+    arena->resident_pages++;
+    fault_stats.faults++;
+    fault_stats.resident_pages++;
+    return true;
+}
+
+vmm_fault_stats_t vmm_get_fault_stats(void) {
+    return fault_stats;
 }
 
 void vmm_dump_state(void) {
-    assert(vmm_initialized && "VMM not initialized");
-    
-    size_t used = 0, free = 0, reserved = 0;
-    printf("[vmm] Page table dump:\n");
-    for (size_t i = 0; i < VMM_MAX_PAGES; ) {
-        if (page_table[i].alloc_pages > 0) {
-            // Print allocation block
+    if (!vmm_initialized) return;
+
+    for (size_t i = 0; i < VMM_MAX_ARENAS; i++) {
+        vmm_arena_t *arena = &arenas[i];
+        if (!arena->in_use) continue;
+
+        vmm_extent_t *extent;
+        printf("[vmm] Arena 0x%08x-0x%08x extents:\n",
+               (unsigned)arena->base, (unsigned)(arena_end(arena) - 1));
+        RB_FOREACH(extent, vmm_extent_tree, &arena->alloc_tree) {
             printf("  0x%08x-0x%08x: %4zu pages (%6.2f KB) - %s %s (tag: 0x%08x)\n",
-                  (unsigned)page_table[i].base_addr,
-                  (unsigned)(page_table[i].base_addr + page_table[i].alloc_pages * VMM_PAGE_SIZE - 1),
-                  page_table[i].alloc_pages,
-                  (page_table[i].alloc_pages * VMM_PAGE_SIZE) / 1024.0,
-                  page_table[i].is_kernel ? "KERNEL" : "USER  ",
-                  page_table[i].state == VMM_PAGE_USED ? "USED" : 
-                  page_table[i].state == VMM_PAGE_RESERVED ? "RESERVED" : "FREE",
-                  page_table[i].tag);
-            
-            if (page_table[i].state == VMM_PAGE_USED) used += page_table[i].alloc_pages;
-            else if (page_table[i].state == VMM_PAGE_RESERVED) reserved += page_table[i].alloc_pages;
-            else free += page_table[i].alloc_pages;
-            
-            i += page_table[i].alloc_pages;
-        } else {
-            // Single page
-            if (page_table[i].state == VMM_PAGE_USED) used++;
-            else if (page_table[i].state == VMM_PAGE_RESERVED) reserved++;
-            else free++;
-            
-            i++;
+                  (unsigned)extent->base,
+                  (unsigned)(extent_end(extent) - 1),
+                  extent->pages,
+                  (extent->pages * VMM_PAGE_SIZE) / 1024.0,
+                  extent->is_kernel ? "KERNEL" : "USER  ",
+                  extent->state == VMM_PAGE_USED ? "USED" : "RESERVED",
+                  extent->tag);
         }
+
+        size_t used_kb, free_kb, reserved_kb;
+        vmm_arena_stats(arena, &used_kb, &free_kb, &reserved_kb);
+        printf("[vmm] Summary: Used: %zu KB (%zu KB resident), Free: %zu KB, Reserved: %zu KB, %zu extents\n",
+               used_kb, arena->resident_pages * VMM_PAGE_SIZE / 1024, free_kb, reserved_kb,
+               arena->extents);
     }
-    
-    printf("[vmm] Summary: Used: %zu KB, Free: %zu KB, Reserved: %zu KB\n",
-           used * VMM_PAGE_SIZE / 1024,
-           free * VMM_PAGE_SIZE / 1024,
-           reserved * VMM_PAGE_SIZE / 1024);
+    printf("[vmm] Extent descriptors: %zu pages\n", extent_pages);
+    printf("[vmm] Page faults: %zu handled, %zu unhandled\n",
+           fault_stats.faults, fault_stats.unhandled);
 }
 
-void vmm_stats(size_t* used_kb, size_t* free_kb, size_t* reserved_kb) {
+void vmm_arena_stats(vmm_arena_t* arena, size_t* used_kb, size_t* free_kb, size_t* reserved_kb) {
     size_t used = 0, free = 0, reserved = 0;
-    
-    for (size_t i = 0; i < VMM_MAX_PAGES; ) {
-        if (page_table[i].alloc_pages > 0) {
-            if (page_table[i].state == VMM_PAGE_USED) used += page_table[i].alloc_pages;
-            else if (page_table[i].state == VMM_PAGE_RESERVED) reserved += page_table[i].alloc_pages;
-            else free += page_table[i].alloc_pages;
-            i += page_table[i].alloc_pages;
-        } else {
-            if (page_table[i].state == VMM_PAGE_USED) used++;
-            else if (page_table[i].state == VMM_PAGE_RESERVED) reserved++;
-            else free++;
-            i++;
-        }
+
+    if (arena && arena->in_use) {
+        used = arena->used_pages;
+        reserved = arena->reserved_pages;
+        free = arena->pages - used - reserved;
     }
-    
+
     if (used_kb) *used_kb = used * VMM_PAGE_SIZE / 1024;
     if (free_kb) *free_kb = free * VMM_PAGE_SIZE / 1024;
     if (reserved_kb) *reserved_kb = reserved * VMM_PAGE_SIZE / 1024;
 }
 
+size_t vmm_arena_largest_free(vmm_arena_t* arena) {
+    if (!arena || !arena->in_use) return 0;
+
+    vmm_extent_t *root = RB_ROOT(&arena->free_tree);
+    return root ? root->max_pages * VMM_PAGE_SIZE : 0;
+}
+
+void vmm_stats(size_t* used_kb, size_t* free_kb, size_t* reserved_kb) {
+    vmm_arena_stats(kernel_arena, used_kb, free_kb, reserved_kb);
+}
+
 size_t vmm_get_total_memory(void) {
-    return VMM_MAX_PAGES * VMM_PAGE_SIZE;
+    return kernel_arena ? kernel_arena->pages * VMM_PAGE_SIZE : 0;
 }
 
 size_t vmm_get_largest_free_block(void) {
-    size_t max_free = 0;
-    size_t current_free = 0;
-    
-    for (size_t i = 0; i < VMM_MAX_PAGES; ++i) {
-        if (page_table[i].state == VMM_PAGE_FREE) {
-            current_free++;
-            if (current_free > max_free) {
-                max_free = current_free;
-            }
-        } else {
-            current_free = 0;
-        }
-    }
-    
-    return max_free * VMM_PAGE_SIZE;
+    return vmm_arena_largest_free(kernel_arena);
 }
 
 void vmm_set_tag(void* addr, uint32_t tag) {
     if (!addr) return;
-    
-    uintptr_t target = (uintptr_t)addr;
-    for (size_t i = 0; i < VMM_MAX_PAGES; ++i) {
-        if (page_table[i].base_addr <= target && 
-            target < page_table[i].base_addr + page_table[i].size) {
-            if (page_table[i].state == VMM_PAGE_USED) {
-                page_table[i].tag = tag;
-            }
-            return;
-        }
+
+    vmm_arena_t *arena = arena_for_addr((uintptr_t)addr);
+    vmm_extent_t *extent = arena ? extent_lookup(&arena->alloc_tree, (uintptr_t)addr) : NULL;
+    if (extent && extent->state == VMM_PAGE_USED) {
+        extent->tag = tag;
     }
 }
 
 uint32_t vmm_get_tag(void* addr) {
     if (!addr) return 0;
-    
-    uintptr_t target = (uintptr_t)addr;
-    for (size_t i = 0; i < VMM_MAX_PAGES; ++i) {
-        if (page_table[i].base_addr <= target && 
-            target < page_table[i].base_addr + page_table[i].size) {
-            return page_table[i].tag;
-        }
-    }
-    return 0;
-}
 
+    vmm_arena_t *arena = arena_for_addr((uintptr_t)addr);
+    vmm_extent_t *extent = arena ? extent_lookup(&arena->alloc_tree, (uintptr_t)addr) : NULL;
+    return extent ? extent->tag : 0;
+}
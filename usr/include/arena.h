@@ -0,0 +1,36 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_CHUNK_PAGES  4            // Pages taken per refill, unless a request needs more
+#define ARENA_ALIGN        8
+#define ARENA_OWNER_TAG    0x4152454E   // "AREN" in the page database
+
+// A run of pages owned by an arena; allocations follow the header
+typedef struct arena_chunk {
+    struct arena_chunk *next;   // Previous (older) chunk
+    size_t pages;
+} arena_chunk_t;
+
+typedef struct arena {
+    arena_chunk_t *chunks;      // Newest first; the oldest holds this header
+    char *ptr;                  // Next free byte in the newest chunk
+    char *limit;                // End of the newest chunk
+    size_t pages;               // Pages held across all chunks
+} arena_t;
+
+// Position to roll an arena back to
+typedef struct {
+    arena_chunk_t *chunk;
+    char *ptr;
+} arena_mark_t;
+
+arena_t* arena_create(void);
+void arena_destroy(arena_t *arena);
+void* arena_alloc(arena_t *arena, size_t size);
+arena_mark_t arena_mark(const arena_t *arena);
+void arena_reset(arena_t *arena, arena_mark_t mark);
+
+#endif // ARENA_H
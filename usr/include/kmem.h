@@ -0,0 +1,42 @@
+#ifndef KMEM_H
+#define KMEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KMEM_MAX_CACHES      32
+#define KMEM_NAME_MAX        24
+#define KMEM_MAX_SLAB_PAGES  8          // Largest slab: 32 KB
+#define KMEM_MAX_OBJECTS     0xFFFF     // Free list indices are 16-bit
+#define KMEM_CACHE_LINE      32         // Smallest coloring step
+#define KMEM_OWNER_TAG       0x4B4D454D // "KMEM" in the page database
+
+// Runs once per object when its slab is created, not on every allocation.
+// Objects must be handed back to kmem_cache_free() in constructed state.
+typedef void (*kmem_ctor_t)(void *obj);
+
+typedef struct kmem_cache kmem_cache_t;
+
+// Per-cache counters
+typedef struct {
+    size_t obj_size;        // Object size after alignment
+    size_t objs_per_slab;
+    size_t slab_pages;      // Pages per slab
+    size_t slabs;           // Slabs currently held
+    size_t active;          // Objects handed out
+    size_t allocs;          // Lifetime kmem_cache_alloc() calls that succeeded
+    size_t frees;
+    size_t grows;           // Slabs taken from the PMM
+    size_t reaps;           // Slabs given back to the PMM
+    size_t failures;        // Allocations that found no memory
+} kmem_cache_stats_t;
+
+kmem_cache_t* kmem_cache_create(const char *name, size_t size, size_t align, kmem_ctor_t ctor);
+int kmem_cache_destroy(kmem_cache_t *cache);
+void* kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+int kmem_cache_get_stats(const kmem_cache_t *cache, kmem_cache_stats_t *stats);
+void kmem_dump_stats(void);
+
+#endif // KMEM_H
@@ -7,7 +7,10 @@
 #include <pmm.h>
 
 #define PAGE_ENTRIES   1024
+#define PAGE_ENTRIES_PAE 512
 #define PAGE_SIZE      4096
+#define PAGE_LARGE_SIZE 0x400000     // One directory entry with PSE
+#define PAGE_LARGE_SIZE_PAE 0x200000 // One directory entry under PAE
 
 // Page flags
 #define PAGE_PRESENT    0x001
@@ -19,6 +22,29 @@
 #define PAGE_DIRTY      0x040
 #define PAGE_PAT        0x080
 #define PAGE_GLOBAL     0x100
+#define PAGE_LARGE      0x080   // PS bit, directory entries only
+#define PAGE_LARGE_PAT  0x1000  // PAT bit of a large entry
+#define PAGE_NX         0x80000000u // No-execute; bit 63 under PAE, ignored otherwise
+#define PAGE_COW        0x200   // Software bit: read-only until copied on write
+
+#define PAGING_OWNER_TAG 0xFEED0000  // Page database owner of table frames
+
+// Recursive self-map: the last directory slots point back at the
+// directories, so the active space's tables sit at fixed addresses
+#define PAGING_PT_WINDOW      0xFFC00000  // Page tables, one page per 4 MB
+#define PAGING_PD_WINDOW      0xFFFFF000  // The page directory (slot 1023)
+#define PAGING_PAE_PT_WINDOW  0xFF800000  // Page tables, one page per 2 MB
+#define PAGING_PAE_PD_WINDOW  0xFFFFC000  // The four directories (PD3 slots 508-511)
+
+// Range operations invalidate up to this many pages with invlpg; past it
+// one full TLB flush is cheaper. Tunable with paging_set_flush_threshold().
+#define PAGING_FLUSH_THRESHOLD 32
+#define PAGING_FLUSH_BATCH     64    // Upper bound for the threshold
+
+// Address spaces. The user half runs from the end of the identity map of
+// RAM up to PAGING_USER_END; the kernel arena and the self-map lie above.
+#define PAGING_USER_END  0xC0000000
+#define VM_SPACE_MAX     64
 
 typedef uint32_t page_entry_t;
 
@@ -30,13 +56,66 @@ typedef struct page_directory {
     page_entry_t entries[PAGE_ENTRIES];
 } __attribute__((aligned(PAGE_SIZE))) page_directory_t;
 
+typedef enum {
+    PAGING_OFF = 0,
+    PAGING_32BIT,           // Two-level tables, 32-bit entries
+    PAGING_PAE              // PDPT -> PD -> PT, 64-bit entries
+} paging_mode_t;
+
+// Memory types for paging_map_range_attr()
+typedef enum {
+    PAGING_ATTR_WB = 0,     // Write-back, for RAM
+    PAGING_ATTR_WC,         // Write-combining, for framebuffers
+    PAGING_ATTR_UC          // Uncached, for device registers
+} paging_attr_t;
+
+typedef struct {
+    size_t invlpg;          // Single-page invalidations issued
+    size_t full_flushes;    // Whole-TLB flushes issued
+    size_t flushes_avoided; // Invalidations skipped or folded into a full flush
+} paging_tlb_stats_t;
+
+// One set of page tables. Directory entries outside the user half are
+// identical in every space.
+typedef struct vm_space {
+    page_directory_t *root; // Page directory, or PDPT under PAE
+    bool in_use;
+} vm_space_t;
+
+typedef struct {
+    size_t switches;        // vm_space_switch() calls
+    size_t cr3_loads;       // Switches that reloaded CR3
+    size_t lazy;            // Switches that kept the loaded tables
+    size_t cow_copies;      // Write faults that copied a shared frame
+    size_t cow_reuses;      // Write faults that took back an unshared frame
+} vm_space_stats_t;
+
+// Root of the active tables: the page directory, or the PDPT under PAE
 extern page_directory_t *current_page_directory;
 
 void paging_init(void);
 bool paging_map_page(uintptr_t virt_addr, uintptr_t phys_addr, uint32_t flags);
 bool paging_unmap_page(uintptr_t virt_addr);
+bool paging_map_range(uintptr_t virt_addr, uintptr_t phys_addr, size_t pages, uint32_t flags);
+bool paging_map_range_attr(uintptr_t virt_addr, uintptr_t phys_addr, size_t pages,
+                           uint32_t flags, paging_attr_t attr);
+size_t paging_unmap_range(uintptr_t virt_addr, size_t pages);
+void paging_set_flush_threshold(size_t pages);
+paging_tlb_stats_t paging_get_tlb_stats(void);
 uintptr_t paging_get_physical(uintptr_t virt_addr);
+size_t paging_large_pages(void);
+paging_mode_t paging_get_mode(void);
 void paging_enable(void);
 void paging_invalidate(uintptr_t virt_addr);
 
+// Address spaces
+vm_space_t *vm_space_create(void);
+vm_space_t *vm_space_clone(vm_space_t *parent);
+bool vm_space_handle_cow(uintptr_t addr, uint32_t error);
+int vm_space_destroy(vm_space_t *space);
+void vm_space_switch(vm_space_t *space);
+vm_space_t *vm_space_current(void);
+vm_space_t *vm_space_kernel(void);
+vm_space_stats_t vm_space_get_stats(void);
+
 #endif // _PAGING_H_
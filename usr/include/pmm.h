@@ -7,6 +7,15 @@
 
 #define PMM_PAGE_SIZE 4096
 #define PMM_BITMAP_BITS (sizeof(uint64_t) * 8)  // 64 bits per bitmap entry
+#define PMM_MAX_ORDER 10                        // Largest buddy block: 2^10 pages (4 MB)
+#define PMM_MAX_CPUS 8
+#define PMM_MAGAZINE_SIZE 32                    // Frames cached per CPU and zone
+#define PMM_MAGAZINE_BATCH 16                   // Frames moved per refill/drain
+#define PMM_ZERO_POOL_SIZE 64                   // Pre-zeroed frames kept ready
+#define PMM_MAX_COLORS 256                      // Cap on L2 page colors
+
+#define PMM_DMA_LIMIT    0x01000000             // ISA DMA reaches the first 16 MB
+#define PMM_NORMAL_LIMIT 0x38000000             // 896 MB
 
 // Memory zone definitions
 typedef enum {
@@ -26,14 +35,58 @@ typedef struct {
     size_t zones_free[PMM_ZONE_COUNT];
 } pmm_stats_t;
 
+// Per-CPU page magazine counters
+typedef struct {
+    size_t hits;        // Single-page allocs served from the magazine
+    size_t misses;      // Single-page allocs that had to refill first
+    size_t refills;     // Batches pulled from the zone allocator
+    size_t drains;      // Batches pushed back to the zone allocator
+} pmm_cpu_stats_t;
+
+// Pre-zeroed page pool counters
+typedef struct {
+    size_t hits;          // Zeroed allocations served from the pool
+    size_t misses;        // Zeroed allocations cleared on the spot
+    uint64_t idle_bytes;  // Bytes zeroed from the idle loop
+} pmm_zero_stats_t;
+
+// Buddy free list links (page indices, valid only for free block heads)
+typedef struct {
+    uint32_t next;
+    uint32_t prev;
+} pmm_buddy_link_t;
+
+// Per-order buddy free list
+typedef struct {
+    uint32_t head;      // First free block of this order
+    size_t count;       // Number of free blocks of this order
+} pmm_free_area_t;
+
+// Page frame database entry, one per frame (8 per cache line)
+typedef struct vm_page {
+    uint16_t refcount;  // 0 while the frame is free
+    uint8_t flags;      // VM_PAGE_*
+    uint8_t zone;       // pmm_zone_t of the owning region
+    uint32_t owner;     // Subsystem tag for accounting, 0 if untagged
+} vm_page_t;
+
+#define VM_PAGE_RESERVED 0x01   // Firmware, kernel image or PMM metadata
+
 // Memory region descriptor
 typedef struct pmm_region {
     uintptr_t base;
     size_t pages;
     uint64_t *bitmap;
     size_t bitmap_size;
+    uint64_t *summary;  // Bit set when the matching bitmap word has a free page
+    size_t summary_size;
+    size_t free_pages;
     size_t last_alloc;  // Hint for next allocation
     pmm_zone_t zone;
+    uint8_t *order_map;         // Order + 1 of the free block starting at a page, 0 otherwise
+    pmm_buddy_link_t *links;    // Free list links, one per page
+    vm_page_t *vm_pages;        // Page frame database, one entry per page
+    pmm_free_area_t free_area[PMM_MAX_ORDER + 1];
     struct pmm_region *next;
 } pmm_region_t;
 
@@ -47,12 +100,37 @@ void* pmm_alloc_page(void);
 void* pmm_alloc_pages(size_t count);
 void* pmm_alloc_page_zone(pmm_zone_t zone);
 void* pmm_alloc_pages_zone(size_t count, pmm_zone_t zone);
+void* pmm_alloc_constrained(size_t count, pmm_zone_t zone, size_t align, size_t boundary);
 int pmm_free_page(void* addr);
 int pmm_free_pages(void* addr, size_t count);
+size_t pmm_alloc_bulk(size_t n, void **out, pmm_zone_t zone);
+int pmm_free_bulk(void **pages, size_t n);
+
+// Per-CPU magazines
+void pmm_drain_magazines(void);
+int pmm_get_cpu_stats(unsigned cpu, pmm_cpu_stats_t *stats);
+
+// Pre-zeroed pages
+void* pmm_alloc_zeroed_page(void);
+void pmm_idle_zero(void);
+pmm_zero_stats_t pmm_get_zero_stats(void);
+
+// Page coloring
+unsigned pmm_color_count(void);
+void* pmm_alloc_page_color(pmm_zone_t zone, unsigned *hint);
+void* pmm_alloc_zeroed_page_color(unsigned *hint);
+
+// Page frame database
+vm_page_t* pmm_page_lookup(void* addr);
+int pmm_page_get(void* addr);
+int pmm_page_put(void* addr);
+int pmm_page_set_owner(void* addr, size_t count, uint32_t owner);
+size_t pmm_owner_pages(uint32_t owner);
 
 // Utility functions
 bool pmm_is_page_allocated(void* addr);
 pmm_stats_t pmm_get_stats(void);
+uintptr_t pmm_highest_address(void);
 void pmm_dump_state(void);
 void pmm_dump_stats(void);
 
@@ -69,4 +147,11 @@ static inline uintptr_t pmm_page_align_up(uintptr_t addr) {
     return (addr + PMM_PAGE_SIZE - 1) & ~(PMM_PAGE_SIZE - 1);
 }
 
+// Zone a physical address belongs to
+static inline pmm_zone_t pmm_zone_for_addr(uintptr_t addr) {
+    if (addr < PMM_DMA_LIMIT) return PMM_ZONE_DMA;
+    if (addr < PMM_NORMAL_LIMIT) return PMM_ZONE_NORMAL;
+    return PMM_ZONE_HIGH;
+}
+
 #endif // PMM_H
@@ -9,6 +9,7 @@
 #include <string.h>
 #include <sys/fs.h>
 #include <sys/queue.h>
+#include <arena.h>
 
 #define SHELL_MAX_INPUT_LENGTH 256
 #define SHELL_MAX_ARGS 32
@@ -53,6 +54,9 @@ typedef struct {
     
     // Exit status of last command
     int last_exit_status;
+
+    // Scratch memory for the running command, rewound when it returns
+    arena_t *arena;
 } shell_context_t;
 
 // Shell functions
@@ -64,6 +68,7 @@ int shell_execute(shell_context_t *ctx, int argc, char **argv);
 void shell_print_error(const char *message);
 void shell_print_not_found(const char *command);
 void shell_cleanup(shell_context_t *ctx);
+arena_t *shell_arena(void);
 
 // History functions
 void shell_add_to_history(shell_context_t *ctx, const char *command);
@@ -106,5 +111,8 @@ extern int rmdir_main(int argc, char **argv);
 extern int pwd_main(int argc, char **argv);
 extern int sleep_main(int argc, char **argv);
 extern int figlet_main(int argc, char **argv);
+extern int heapprof_main(int argc, char **argv);
+extern int vmswitch_main(int argc, char **argv);
+extern int blitbench_main(int argc, char **argv);
 
 #endif // SHELL_H
@@ -39,6 +39,29 @@ void* calloc(size_t num, size_t size);
 void* realloc(void* ptr, size_t size);
 void free(void* ptr);
 
+// Heap profiler, recording only in kernels built with MALLOC_PROFILE
+#define MALLOC_PROFILE_SITES    256   // Distinct call sites tracked
+#define MALLOC_PROFILE_SAMPLES  512   // Most recent samples kept
+#define MALLOC_PROFILE_INTERVAL 4096  // Bytes allocated between samples
+
+typedef struct {
+    void* site;         // Return address of the allocating call
+    size_t bytes;       // Estimated bytes requested (growth only, for realloc)
+    size_t count;       // Estimated allocations
+    size_t samples;     // Allocations actually sampled
+} malloc_site_t;
+
+typedef struct {
+    void* site;
+    size_t size;
+    uint64_t tsc;       // rdtsc() at allocation
+} malloc_sample_t;
+
+size_t malloc_profile_sites(malloc_site_t* out, size_t max, bool by_count);
+size_t malloc_profile_samples(malloc_sample_t* out, size_t max);
+size_t malloc_profile_dropped(void);
+void malloc_profile_reset(void);
+
 // Process control functions
 void abort(void);
 void exit(int status);
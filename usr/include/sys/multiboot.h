@@ -7,6 +7,14 @@
 #define MULTIBOOT_HEADER_FLAGS 0x00000003  // Align modules on page boundaries and provide memory map
 #define MULTIBOOT_INFO_MAGIC   0x2BADB002
 #define MULTIBOOT_INFO_MEMORY  0x00000001
+#define MULTIBOOT_INFO_MEM_MAP 0x00000040
+
+// Memory map entry types
+#define MULTIBOOT_MEMORY_AVAILABLE        1
+#define MULTIBOOT_MEMORY_RESERVED         2
+#define MULTIBOOT_MEMORY_ACPI_RECLAIMABLE 3
+#define MULTIBOOT_MEMORY_NVS              4
+#define MULTIBOOT_MEMORY_BADRAM           5
 
 // Multiboot header structure
 struct multiboot_header {
@@ -20,7 +28,26 @@ struct multiboot_info {
     uint32_t flags;
     uint32_t mem_lower;    // Memory below 1MB (in KB)
     uint32_t mem_upper;    // Memory above 1MB (in KB)
-    // Add other fields as needed
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];      // a.out symbol table or ELF section headers
+    uint32_t mmap_length;  // Size of the memory map buffer (in bytes)
+    uint32_t mmap_addr;    // Physical address of the first mmap entry
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
 };
 
+// BIOS memory map entry; size does not count the size field itself
+struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed));
+
 #endif // MULTIBOOT_H
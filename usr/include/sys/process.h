@@ -16,11 +16,14 @@ typedef enum {
     PROCESS_ZOMBIE
 } ProcessState;
 
+struct vm_space;
+
 typedef struct {
     int pid;
     char name[MAX_PROCESS_NAME];
     ProcessState state;
     int ppid;  // Parent process ID
+    struct vm_space *space;  // Address space, NULL for a kernel thread
     bool used;
 } Process;
 
@@ -29,6 +32,7 @@ extern Process process_table[MAX_PROCESSES];
 // Process management
 void process_init(void);
 int process_create(const char *name, int ppid);
+int process_fork(int pid);
 int process_kill(int pid);
 int process_cleanup(int pid);
 Process *process_get(int pid);
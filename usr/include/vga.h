@@ -77,6 +77,9 @@ static inline uint16_t vga_entry(unsigned char uc, uint8_t color) {
 #define VGA_COLOR_INFO    ((uint8_t)((VGA_COLOR_WHITE) | ((VGA_COLOR_BLUE) << 4)))
 
 // Screen dimensions
+#define VGA_TEXT_PHYS 0xB8000   // Text-mode framebuffer
+#define VGA_TEXT_SIZE 0x8000
+
 #define VGA_WIDTH  80
 #define VGA_HEIGHT 25
 
@@ -4,10 +4,12 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/tree.h>
 
 #define VMM_PAGE_SIZE        4096
-#define VMM_MAX_PAGES        1024
-#define VMM_BASE_ADDRESS     0x100000  // Start after kernel
+#define VMM_BASE_ADDRESS     0xC0000000  // Kernel arena, above identity-mapped RAM
+#define VMM_KERNEL_SIZE      0x10000000  // 256 MB
+#define VMM_MAX_ARENAS       8
 #define VMM_TAG_KERNEL       0xDEAD0000
 #define VMM_TAG_USER         0xBEEF0000
 
@@ -17,19 +19,54 @@ typedef enum {
     VMM_PAGE_RESERVED = 2
 } vmm_page_state_t;
 
-typedef struct {
-    uintptr_t base_addr;
-    size_t size;
+// A run of pages in one state. Allocated and reserved extents live in an
+// address-ordered tree, free extents in another whose nodes also carry the
+// largest free extent of their subtree.
+typedef struct vmm_extent {
+    RB_ENTRY(vmm_extent) link;
+    uintptr_t base;
+    size_t pages;
+    size_t max_pages;     // Largest extent in this subtree (free tree only)
+    size_t resident;      // Pages backed by a frame so far (used extents)
     vmm_page_state_t state;
-    size_t alloc_pages;   // Number of pages in this allocation (set only on first page)
     uint32_t tag;         // Tag for ownership/debug
     bool is_kernel;       // Kernel vs user allocation
-} vmm_page_t;
+} vmm_extent_t;
+
+RB_HEAD(vmm_extent_tree, vmm_extent);
+
+// A managed range of address space with its own extent trees and counters
+typedef struct {
+    uintptr_t base;
+    size_t pages;
+    size_t used_pages;
+    size_t reserved_pages;
+    size_t resident_pages;  // Frames faulted in across the arena
+    size_t extents;       // Descriptors in use by this arena
+    struct vmm_extent_tree alloc_tree;
+    struct vmm_extent_tree free_tree;
+    bool in_use;
+} vmm_arena_t;
+
+// Demand paging counters
+typedef struct {
+    size_t faults;          // Faults resolved by mapping a fresh frame
+    size_t unhandled;       // Faults outside any allocation, or out of frames
+    size_t resident_pages;  // Frames currently backing allocations
+} vmm_fault_stats_t;
 
 // Initialization
 void vmm_init(void);
 void vmm_reserve_range(uintptr_t start, uintptr_t end);
 
+// Arenas
+vmm_arena_t* vmm_arena_create(uintptr_t base, size_t size);
+int vmm_arena_destroy(vmm_arena_t* arena);
+void* vmm_arena_alloc(vmm_arena_t* arena, size_t size, size_t align, uint32_t tag, bool is_kernel);
+void vmm_arena_stats(vmm_arena_t* arena, size_t* used_kb, size_t* free_kb, size_t* reserved_kb);
+size_t vmm_arena_largest_free(vmm_arena_t* arena);
+vmm_arena_t* vmm_kernel_arena(void);
+
 // Allocation
 void* vmm_alloc(size_t size);
 void* vmm_alloc_aligned(size_t size, size_t align);
@@ -38,6 +75,10 @@ void* vmm_alloc_tagged(size_t size, uint32_t tag, bool is_kernel);
 // Deallocation
 void vmm_free(void* addr);
 
+// Demand paging
+bool vmm_handle_fault(uintptr_t addr, uint32_t error);
+vmm_fault_stats_t vmm_get_fault_stats(void);
+
 // Information
 void vmm_dump_state(void);
 void vmm_stats(size_t* used_kb, size_t* free_kb, size_t* reserved_kb);
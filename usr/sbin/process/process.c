@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdatomic.h>
 #include <sys/process.h>
+#include <paging.h>
 
 Process process_table[MAX_PROCESSES];
 static atomic_int next_pid = 100;
@@ -26,6 +27,37 @@ int process_create(const char *name, int ppid) {
             p->name[MAX_PROCESS_NAME - 1] = '\0';
             p->state = PROCESS_RUNNING;
             p->ppid = ppid;
+            // Without paging, or short of memory, it runs as a kernel thread
+            p->space = vm_space_create();
+            p->used = true;
+
+            return p->pid;
+        }
+    }
+    return -1;
+}
+
+// Child of pid with the same name, sharing its parent's pages
+// copy-on-write. Returns the child's PID, or -1.
+int process_fork(int pid) {
+    Process *parent = process_get(pid);
+    if (!parent) return -1;
+
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (!process_table[i].used) {
+            Process *p = &process_table[i];
+
+            struct vm_space *space = NULL;
+            if (parent->space) {
+                space = vm_space_clone(parent->space);
+                if (!space) return -1;
+            }
+
+            p->pid = atomic_fetch_add(&next_pid, 1);
+            memcpy(p->name, parent->name, MAX_PROCESS_NAME);
+            p->state = PROCESS_RUNNING;
+            p->ppid = parent->pid;
+            p->space = space;
             p->used = true;
 
             return p->pid;
@@ -52,6 +84,7 @@ int process_cleanup(int pid) {
     for (int i = 0; i < MAX_PROCESSES; i++) {
         Process *p = &process_table[i];
         if (p->used && p->pid == pid && p->state == PROCESS_ZOMBIE) {
+            if (p->space) vm_space_destroy(p->space);
             memset(p, 0, sizeof(Process));
             p->used = false;
             p->state = PROCESS_UNUSED;